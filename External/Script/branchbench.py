@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+branchbench.py - Compare branch behaviour of loop-based and branch-free junk (JUNK_BRANCHLESS).
+
+Builds one small program three times -- without junk, with the default emitters and
+with JUNK_BRANCHLESS=1 -- and runs each. The program walks random data through a
+data-dependent branch (the "real" code) and calls one of --sites junk sites per element.
+Branches and branch misses are read with perf_event_open around the hot loop; where
+hardware counters are unavailable (VMs, perf_event_paranoid) only the time is shown.
+
+Static column: conditional jumps in the junk_detail functions of the binary (objdump).
+
+Usage:
+  python branchbench.py
+  python branchbench.py --cxx clang++ --sites 64 --iters 2000000 --runs 5
+"""
+
+import argparse
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+HERE = Path(__file__).resolve().parent
+INCLUDE = HERE.parent.parent / "Obfuscator" / "Include"
+
+VARIANTS = [
+    ("none",       ["-DBENCH_NO_JUNK=1"]),
+    ("loops",      ["-DJUNK_BRANCHLESS=0"]),
+    ("branchless", ["-DJUNK_BRANCHLESS=1"]),
+]
+
+PROGRAM = r"""
+#include "Junk.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if BENCH_NO_JUNK
+#define SITE() ((void)0)
+#else
+#define SITE() JUNK_CODE_BLOCK()
+#endif
+
+@SITES@
+
+typedef void (*site_fn)();
+static site_fn g_sites[] = { @TABLE@ };
+
+static int open_counter(unsigned long long config, int group) {
+#if defined(__linux__)
+    perf_event_attr a;
+    std::memset(&a, 0, sizeof(a));
+    a.size = sizeof(a);
+    a.type = PERF_TYPE_HARDWARE;
+    a.config = config;
+    a.disabled = group < 0;
+    a.exclude_kernel = 1;
+    a.exclude_hv = 1;
+    return static_cast<int>(syscall(SYS_perf_event_open, &a, 0, -1, group, 0));
+#else
+    (void)config; (void)group;
+    return -1;
+#endif
+}
+
+static long long read_counter(int fd) {
+    long long v = -1;
+    if (fd >= 0 && read(fd, &v, sizeof(v)) != sizeof(v)) v = -1;
+    return v;
+}
+
+int main(int argc, char** argv) {
+    const long iters = argc > 1 ? std::atol(argv[1]) : 1000000;
+    const unsigned nsites = sizeof(g_sites) / sizeof(g_sites[0]);
+    std::vector<unsigned> data(1u << 16);
+    unsigned x = 2463534242u;
+    for (auto& d : data) { x ^= x << 13; x ^= x >> 17; x ^= x << 5; d = x; }
+
+    const int misses = open_counter(PERF_COUNT_HW_BRANCH_MISSES, -1);
+    const int branches = misses >= 0 ? open_counter(PERF_COUNT_HW_BRANCH_INSTRUCTIONS, misses) : -1;
+    if (misses >= 0) { ioctl(misses, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP); ioctl(misses, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP); }
+
+    const auto t0 = std::chrono::steady_clock::now();
+    volatile unsigned long long sum = 0;
+    for (long i = 0; i < iters; ++i) {
+        const unsigned d = data[static_cast<size_t>(i) & 0xFFFF];
+        if (d & 0x80000000u) sum = sum + d;     // unpredictable on purpose
+        else                 sum = sum ^ (d >> 3);
+        g_sites[d % nsites]();
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+
+    if (misses >= 0) ioctl(misses, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    std::printf("%lld %lld %.3f\n", read_counter(branches), read_counter(misses),
+                std::chrono::duration<double, std::milli>(t1 - t0).count());
+    return 0;
+}
+"""
+
+_JCC = re.compile(r"\tj(?!mp)[a-z]+\s")
+
+
+def build(cxx: str, src: Path, out: Path, defs, extra) -> None:
+    cmd = [cxx, "-std=c++20", "-O2", f"-I{INCLUDE}", *defs, *extra, str(src), "-o", str(out)]
+    res = subprocess.run(cmd, capture_output=True, text=True)
+    if res.returncode != 0:
+        sys.stderr.write(res.stderr)
+        raise subprocess.CalledProcessError(res.returncode, cmd)
+
+
+def junk_jcc(binary: Path) -> int:
+    dis = subprocess.run(["objdump", "-d", "-C", "--no-show-raw-insn", str(binary)],
+                         capture_output=True, text=True, check=True).stdout
+    count, inside = 0, False
+    for line in dis.splitlines():
+        if line.endswith(">:"):
+            inside = "junk_detail::" in line
+        elif inside and _JCC.search(line):
+            count += 1
+    return count
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Branch misses of loop-based vs branch-free junk.")
+    ap.add_argument("--cxx", default="g++", help="C++ compiler (default: g++).")
+    ap.add_argument("--sites", type=int, default=32, help="Distinct junk sites in the program.")
+    ap.add_argument("--iters", type=int, default=1000000, help="Hot-loop iterations per run.")
+    ap.add_argument("--runs", type=int, default=3, help="Runs per variant (best time is kept).")
+    ap.add_argument("--keep", action="store_true", help="Keep the build directory.")
+    ap.add_argument("extra", nargs="*", help="Extra compiler flags, after --.")
+    args = ap.parse_args()
+
+    work = Path(tempfile.mkdtemp(prefix="branchbench-"))
+    src = work / "bench.cpp"
+    src.write_text(PROGRAM
+                   .replace("@SITES@", "\n".join(f"static void site{i}() {{ SITE(); }}" for i in range(args.sites)))
+                   .replace("@TABLE@", ", ".join(f"site{i}" for i in range(args.sites))),
+                   encoding="utf-8")
+
+    print(f"{'variant':<12}{'branches':>14}{'misses':>12}{'miss/iter':>11}{'time ms':>10}{'junk jcc':>10}")
+    try:
+        for name, defs in VARIANTS:
+            exe = work / name
+            build(args.cxx, src, exe, defs, args.extra)
+            best = None
+            for _ in range(max(1, args.runs)):
+                out = subprocess.run([str(exe), str(args.iters)], capture_output=True, text=True, check=True).stdout
+                br, miss, ms = out.split()
+                row = (int(br), int(miss), float(ms))
+                if best is None or row[2] < best[2]:
+                    best = row
+            br, miss, ms = best
+            if miss < 0:
+                cols = f"{'n/a':>14}{'n/a':>12}{'n/a':>11}"
+            else:
+                cols = f"{br:>14}{miss:>12}{miss / args.iters:>11.3f}"
+            print(f"{name:<12}{cols}{ms:>10.1f}{junk_jcc(exe):>10}")
+    except (subprocess.CalledProcessError, FileNotFoundError) as e:
+        print(f"branchbench: {e}", file=sys.stderr)
+        sys.exit(1)
+    finally:
+        if args.keep:
+            print(f"\nBuild directory: {work}")
+        else:
+            shutil.rmtree(work, ignore_errors=True)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,4 @@
+// Line splice and escape at end of file.
+#include <cstdio>
+void f() { std::printf("a\n"); }
+#define TRAILING \
@@ -0,0 +1,10 @@
+// Unterminated character literals and stray quotes.
+#include <cstdio>
+
+int f() {
+    char c = 'a;
+    char d = '\';
+    return c + d;
+}
+
+int g() { std::printf("g\n"); return 'x'; }
@@ -0,0 +1,14 @@
+// Unterminated string literal at the end of a function.
+#include <cstdio>
+
+void before() {
+    std::printf("fine\n");
+}
+
+void broken() {
+    std::printf("never closed
+}
+
+void after() {
+    std::printf("after\n");
+}
@@ -0,0 +1,51 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+dynsymcheck.py - Fail if a shared object exports junk symbols (GCC/Clang, ELF).
+
+Everything Junk.h defines is internal or hidden, so nothing of it should be in .dynsym:
+neither junk_detail symbols nor the linker-defined bounds of the runtime-switch site
+table (__start_/__stop_junk_jump_table), which would let one module's table interpose
+another's. GNU ld keeps those bounds in .dynsym even when they are declared hidden; the
+CMake build links with a version script that makes them local and runs this check.
+Exits with status 1 if any such symbol is found.
+
+Usage:
+  python dynsymcheck.py libObfuscator.so
+  python dynsymcheck.py --nm llvm-nm build/*.so
+"""
+
+import argparse
+import re
+import subprocess
+import sys
+
+_JUNK = re.compile(r"junk_detail|junk_jump_table")
+
+
+def exported(nm: str, lib: str):
+    out = subprocess.run([nm, "-D", "--defined-only", lib], capture_output=True, text=True, check=True).stdout
+    return [line.split()[-1] for line in out.splitlines() if _JUNK.search(line)]
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Fail if a shared object exports junk symbols.")
+    ap.add_argument("libs", nargs="+", help="Shared objects to check.")
+    ap.add_argument("--nm", default="nm", help="nm to use (default: nm).")
+    args = ap.parse_args()
+
+    failed = False
+    for lib in args.libs:
+        try:
+            syms = exported(args.nm, lib)
+        except (subprocess.CalledProcessError, FileNotFoundError) as e:
+            print(f"dynsymcheck: {lib}: {e}", file=sys.stderr)
+            sys.exit(1)
+        for s in syms:
+            print(f"{lib}: exports {s}")
+        failed |= bool(syms)
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+formatcheck.py - Check the std::format/print sink rewrite of obfuscate.py (GCC/Clang).
+
+Writes a source with std::format, format_to, print and println calls whose arguments
+are macros, true, enumerators, expressions and variables, runs obfuscate.py on it and
+checks that
+  (a) std::make_format_args is only given the lambda's named parameters (or nothing):
+      it takes Args&... (P2905), so a macro, true or an enumerator does not bind,
+  (b) no marker wraps text that was left unchanged, and
+  (c) the output compiles. With a <format> that has __cpp_lib_format it is used;
+      otherwise a stub with the P2905 make_format_args(Args&...) signature stands in.
+Exits with status 1 if any check fails.
+
+Usage:
+  python formatcheck.py
+  python formatcheck.py --cxx clang++ -- -stdlib=libc++
+"""
+
+import argparse
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+HERE = Path(__file__).resolve().parent
+OBFUSCATE = HERE / "obfuscate.py"
+INCLUDE = HERE.parent.parent / "Obfuscator" / "Include"
+
+PRELUDE = r"""
+#pragma once
+#include <cstdio>
+#include <iterator>
+#include <string>
+#include <string_view>
+#if __has_include(<format>)
+#include <format>
+#endif
+#if defined(__cpp_lib_format)
+#if __has_include(<print>)
+#include <print>
+#endif
+enum class Color { Red, Green };
+template <> struct std::formatter<Color> : std::formatter<int> {
+    auto format(Color c, std::format_context& ctx) const { return std::formatter<int>::format(static_cast<int>(c), ctx); }
+};
+#else
+namespace std {
+template <class... A> struct format_args_stub {};
+template <class... A> format_args_stub<A...> make_format_args(A&...) { return {}; }   // P2905
+template <class... A> string vformat(string_view, format_args_stub<A...>) { return {}; }
+template <class O, class... A> O vformat_to(O out, string_view, format_args_stub<A...>) { return out; }
+template <class... A> void print(const char*, A&&...) {}
+template <class... A> void println(const char*, A&&...) {}
+template <class... A> void println(FILE*, const char*, A&&...) {}
+}
+enum class Color { Red, Green };
+#endif
+"""
+
+SOURCE = r"""#include "format_prelude.h"
+#define VERSION_MAJOR 3
+
+static const char* name = "n";
+auto ns_init = std::format("init={}", VERSION_MAJOR);
+
+std::string calls(int a, int b, bool flag, std::string& s) {
+    std::string r = std::format("v{}.{} {}", VERSION_MAJOR, flag, true);
+    r += std::format("color={}", Color::Red);
+    r += std::format("sum={}", a + b);
+    r += std::format("a={} b={}", a, b);
+    std::format_to(std::back_inserter(s), "x{}", a * 2);
+    std::print("{} {}\n", a, false);
+    std::println(stdout, "{}", VERSION_MAJOR);
+    std::println("plain");
+    return r + std::format("z" "y{}", name);
+}
+"""
+
+_MAKE_ARGS = re.compile(r"std::make_format_args\(([^()]*)\)")
+_NOOP_MARK = re.compile(r"/\*obf\+\*/(.*?)/\*obf=\1\*/", re.S)
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Check the std::format sink rewrite of obfuscate.py.")
+    ap.add_argument("--cxx", default="g++", help="C++ compiler (default: g++).")
+    ap.add_argument("--std", default="c++23", help="Language standard (default: c++23).")
+    ap.add_argument("extra", nargs="*", help="Extra compiler flags, after --.")
+    args = ap.parse_args()
+
+    work = Path(tempfile.mkdtemp(prefix="formatcheck-"))
+    ok = True
+    try:
+        (work / "in" / "src").mkdir(parents=True)
+        (work / "in" / "src" / "format_calls.cpp").write_text(SOURCE, encoding="utf-8")
+        (work / "format_prelude.h").write_text(PRELUDE, encoding="utf-8")
+        subprocess.run([sys.executable, str(OBFUSCATE), str(work / "in"), "--out-dir", str(work / "out"),
+                        "--whitelist", "src", "--jobs", "1", "--seed", "1"],
+                       capture_output=True, text=True, check=True)
+        out = work / "out" / "src" / "format_calls.cpp"
+        text = out.read_text(encoding="utf-8")
+
+        for m in _MAKE_ARGS.finditer(text):
+            if m.group(1).strip() not in ("", "obf_a..."):
+                print(f"FAIL make_format_args binds a non-parameter: {m.group(0)}")
+                ok = False
+        for m in _NOOP_MARK.finditer(text):
+            print(f"FAIL marker around unchanged text: {m.group(0)}")
+            ok = False
+
+        res = subprocess.run([args.cxx, f"-std={args.std}", "-fsyntax-only", f"-I{work}", f"-I{INCLUDE}",
+                              *args.extra, str(out)], capture_output=True, text=True)
+        if res.returncode != 0:
+            print("\n".join(line for line in res.stderr.splitlines() if "error" in line))
+            print("FAIL obfuscated source does not compile")
+            ok = False
+        elif ok:
+            print(f"{len(_MAKE_ARGS.findall(text))} make_format_args sites, output compiles")
+    except (subprocess.CalledProcessError, FileNotFoundError) as e:
+        print(f"formatcheck: {e}", file=sys.stderr)
+        ok = False
+    finally:
+        shutil.rmtree(work, ignore_errors=True)
+    print("PASS" if ok else "FAIL")
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+inlinebytes.py - Check JUNK_INLINE_BYTES() code generation (GCC/Clang, x86/x64).
+
+Builds a small program whose compute() function has several JUNK_INLINE_BYTES() sites
+between ordinary statements, once per optimization level, and checks that
+  (a) the disassembly of compute() has one short jmp per site, each jumping over a
+      byte run of JUNK_INLINE_BYTES_MIN..MAX bytes, and
+  (b) the program prints the result computed here for the same input.
+Exits with status 1 if any check fails.
+
+Usage:
+  python inlinebytes.py
+  python inlinebytes.py --cxx clang++ --opt=-O1,-O3 --max 64 -- -fPIC
+"""
+
+import argparse
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+HERE = Path(__file__).resolve().parent
+INCLUDE = HERE.parent.parent / "Obfuscator" / "Include"
+SITES = 4
+BYTES_MIN, BYTES_MAX = 4, 24   # Junk.h defaults
+
+PROGRAM = r"""
+#include "Junk.h"
+#include <cstdio>
+#include <cstdlib>
+
+extern "C" __attribute__((noinline)) unsigned compute(unsigned x) {
+    JUNK_INLINE_BYTES();
+    x = x * 2654435761u + 1u;
+    JUNK_INLINE_BYTES();
+    x ^= x >> 13;
+    JUNK_INLINE_BYTES();
+    x = (x << 7) | (x >> 25);
+    JUNK_INLINE_BYTES();
+    return x + 0x1234u;
+}
+
+int main(int argc, char** argv) {
+    std::printf("%u\n", compute(static_cast<unsigned>(std::strtoul(argv[argc - 1], nullptr, 0))));
+    return 0;
+}
+"""
+
+_LINE = re.compile(r"^\s*([0-9a-f]+):\t((?:[0-9a-f]{2} )+)\s*\t?(.*)$")
+
+
+def expected(x: int) -> int:
+    m = 0xFFFFFFFF
+    x = (x * 2654435761 + 1) & m
+    x ^= x >> 13
+    x = ((x << 7) | (x >> 25)) & m
+    return (x + 0x1234) & m
+
+
+def disassemble(binary: Path, *opts: str):
+    """(address, raw bytes, instruction text) per instruction; continuation lines are merged."""
+    dis = subprocess.run(["objdump", "-d", "-w", *opts, str(binary)],
+                         capture_output=True, text=True, check=True).stdout
+    insns = []
+    for line in dis.splitlines():
+        m = _LINE.match(line)
+        if m:
+            insns.append((int(m.group(1), 16), bytes(int(b, 16) for b in m.group(2).split()), m.group(3)))
+    return insns
+
+
+def find_sites(binary: Path, name: str, lo: int, hi: int):
+    """Follow compute() from its entry: each 'jmp rel8' over lo..hi bytes is a site, and
+    decoding restarts at its target so the junk bytes cannot desynchronize the listing."""
+    insns = disassemble(binary, f"--disassemble={name}")
+    if not insns:
+        raise ValueError(f"{name} not found in {binary}")
+    end = insns[-1][0] + len(insns[-1][1])
+    sites = []
+    while insns:
+        for addr, raw, _ in insns:
+            if len(raw) == 2 and raw[0] == 0xEB and lo <= raw[1] <= hi:
+                target = addr + 2 + raw[1]
+                run = disassemble(binary, f"--start-address={addr + 2:#x}", f"--stop-address={target:#x}")
+                sites.append((addr, b"".join(r for _, r, _ in run)[:raw[1]]))
+                insns = disassemble(binary, f"--start-address={target:#x}", f"--stop-address={end:#x}")
+                break
+        else:
+            break
+    return sites
+
+
+def check(cxx: str, work: Path, src: Path, opt: str, extra, value: int, lo: int, hi: int) -> bool:
+    exe = work / f"inlinebytes{opt}"
+    cmd = [cxx, "-std=c++20", opt, f"-I{INCLUDE}", *extra, str(src), "-o", str(exe)]
+    res = subprocess.run(cmd, capture_output=True, text=True)
+    if res.returncode != 0:
+        sys.stderr.write(res.stderr)
+        print(f"{opt}: build failed")
+        return False
+
+    sites = find_sites(exe, "compute", lo, hi)
+    for addr, run in sites:
+        print(f"{opt}: jmp at {addr:#x} over {len(run)} bytes: {run.hex(' ')}")
+    ok = len(sites) == SITES
+    if not ok:
+        print(f"{opt}: FAIL expected {SITES} jumps over {lo}..{hi}-byte runs, found {len(sites)}")
+
+    out = subprocess.run([str(exe), str(value)], capture_output=True, text=True, check=True).stdout.strip()
+    want = expected(value)
+    if out != str(want):
+        print(f"{opt}: FAIL compute({value}) = {out}, expected {want}")
+        ok = False
+    else:
+        print(f"{opt}: compute({value}) = {out} (ok)")
+    return ok
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Check JUNK_INLINE_BYTES() jumps and results.")
+    ap.add_argument("--cxx", default="g++", help="C++ compiler (default: g++).")
+    ap.add_argument("--opt", default="-O0,-O2", help="Comma-separated optimization flags to test.")
+    ap.add_argument("--value", type=lambda s: int(s, 0), default=0xC0FFEE, help="Input to compute().")
+    ap.add_argument("--min", type=int, default=BYTES_MIN, help="JUNK_INLINE_BYTES_MIN to build with.")
+    ap.add_argument("--max", type=int, default=BYTES_MAX, help="JUNK_INLINE_BYTES_MAX to build with.")
+    ap.add_argument("extra", nargs="*", help="Extra compiler flags, after --.")
+    args = ap.parse_args()
+
+    work = Path(tempfile.mkdtemp(prefix="inlinebytes-"))
+    src = work / "inlinebytes.cpp"
+    src.write_text(PROGRAM, encoding="utf-8")
+    defs = [f"-DJUNK_INLINE_BYTES_MIN={args.min}", f"-DJUNK_INLINE_BYTES_MAX={args.max}"]
+    try:
+        ok = all([check(args.cxx, work, src, opt, defs + args.extra, args.value, args.min, args.max)
+                  for opt in args.opt.split(",")])
+    except (subprocess.CalledProcessError, FileNotFoundError, ValueError) as e:
+        print(f"inlinebytes: {e}", file=sys.stderr)
+        ok = False
+    finally:
+        shutil.rmtree(work, ignore_errors=True)
+    print("PASS" if ok else "FAIL")
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == "__main__":
+    main()
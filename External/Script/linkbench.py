@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+linkbench.py - Link-time and dlopen-time cost of junk symbol linkage (GCC/Clang, ELF).
+
+Generates a shared library of --tus translation units with --sites junk sites each and
+builds it once per variant:
+  internal  Junk.h defaults: internal linkage + hidden visibility
+  inline    -DJUNK_INTERNAL_LINKAGE=0: inline (COMDAT) emitters, still hidden
+  switch    -DJUNK_RUNTIME_SWITCH=1 as a plain link: GNU ld exports the bounds of the
+            site table (__start_/__stop_junk_jump_table)
+  switch-vs -DJUNK_RUNTIME_SWITCH=1 linked with the version script the CMake build
+            uses to make those bounds local
+  <rev>     Junk.h as of a git revision (--baseline), e.g. the commit before the
+            linkage change, to measure exported, default-visibility junk
+Objects are compiled once per variant; only the link is timed. For every library the
+report lists link time, junk symbols in .dynsym (junk_detail and the site table bounds),
+dynamic relocations, size, and the best dlopen(RTLD_NOW) time over several runs, each
+in a fresh loader process.
+
+Usage:
+  python linkbench.py
+  python linkbench.py --tus 40 --sites 50 --baseline 5f3ae38
+"""
+
+import argparse
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+from concurrent.futures import ThreadPoolExecutor
+from pathlib import Path
+
+HERE = Path(__file__).resolve().parent
+REPO = HERE.parent.parent
+INCLUDE = REPO / "Obfuscator" / "Include"
+
+LOADER = r"""
+#include <dlfcn.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+int main(int argc, char** argv) {
+    const int reps = std::atoi(argv[2]);
+    double best = 1e30;
+    for (int i = 0; i < reps; ++i) {
+        const auto t0 = std::chrono::steady_clock::now();
+        void* h = dlopen(argv[1], RTLD_NOW | RTLD_LOCAL);
+        if (!h) { std::fprintf(stderr, "%s\n", dlerror()); return 1; }
+        const auto t1 = std::chrono::steady_clock::now();
+        dlclose(h);
+        const double us = std::chrono::duration<double, std::micro>(t1 - t0).count();
+        if (us < best) best = us;
+    }
+    std::printf("%.1f\n", best);
+    return 0;
+}
+"""
+
+_RELOC = re.compile(r"^[0-9a-f]{8,}\s")
+_JUNK = re.compile(r"junk_detail|junk_jump_table")
+VERSION_SCRIPT = "{ local: __start_junk_jump_table; __stop_junk_jump_table; };\n"
+
+
+def run(cmd, **kw):
+    res = subprocess.run([str(c) for c in cmd], capture_output=True, text=True, **kw)
+    if res.returncode != 0:
+        sys.stderr.write(res.stderr)
+        raise subprocess.CalledProcessError(res.returncode, cmd)
+    return res.stdout
+
+
+def write_sources(src: Path, tus: int, sites: int):
+    files = []
+    for t in range(tus):
+        body = "\n".join(
+            f"extern \"C\" void tu{t}_f{s}() {{ JUNK_CODE_BLOCK{'_ADVANCED' if s % 4 == 0 else ''}(); }}"
+            for s in range(sites))
+        if t == 0:      # references the site table, as a library with the switch does
+            body += ("\n#if JUNK_RUNTIME_SWITCH\n"
+                     "extern \"C\" bool tu_set_junk(bool on) { return junk_detail::set_enabled(on); }\n#endif")
+        f = src / f"tu{t}.cpp"
+        f.write_text(f"#include \"Junk.h\"\n{body}\n", encoding="utf-8")
+        files.append(f)
+    return files
+
+
+def junk_dynsyms(lib: Path) -> int:
+    return sum(1 for line in run(["readelf", "-W", "--dyn-syms", lib]).splitlines() if _JUNK.search(line))
+
+
+def dyn_relocs(lib: Path) -> int:
+    return sum(1 for line in run(["readelf", "-W", "-r", lib]).splitlines() if _RELOC.match(line))
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Link and dlopen cost of junk symbol linkage.")
+    ap.add_argument("--cxx", default="g++", help="C++ compiler (default: g++).")
+    ap.add_argument("--tus", type=int, default=20, help="Translation units in the library.")
+    ap.add_argument("--sites", type=int, default=30, help="Junk sites per translation unit.")
+    ap.add_argument("--runs", type=int, default=5, help="Link and dlopen repetitions (best is kept).")
+    ap.add_argument("--baseline", action="append", default=[], metavar="REV",
+                    help="Also build with Junk.h from this git revision (repeatable).")
+    ap.add_argument("--keep", action="store_true", help="Keep the build directory.")
+    ap.add_argument("extra", nargs="*", help="Extra compiler flags, after --.")
+    args = ap.parse_args()
+
+    work = Path(tempfile.mkdtemp(prefix="linkbench-"))
+    src = work / "src"
+    src.mkdir()
+    sources = write_sources(src, args.tus, args.sites)
+    (work / "junk_local.map").write_text(VERSION_SCRIPT, encoding="utf-8")
+    switch = ["-DJUNK_RUNTIME_SWITCH=1"]
+    variants = [("internal", INCLUDE, [], []), ("inline", INCLUDE, ["-DJUNK_INTERNAL_LINKAGE=0"], []),
+                ("switch", INCLUDE, switch, []),
+                ("switch-vs", INCLUDE, switch, [f"-Wl,--version-script={work / 'junk_local.map'}"])]
+    for rev in args.baseline:
+        inc = work / f"inc-{rev}"
+        inc.mkdir()
+        header = run(["git", "-C", REPO, "show", f"{rev}:Obfuscator/Include/Junk.h"])
+        (inc / "Junk.h").write_text(header, encoding="utf-8")
+        variants.append((rev, inc, [], []))
+
+    print(f"{args.tus} TUs x {args.sites} sites")
+    print(f"{'variant':<12}{'link ms':>9}{'junk dynsym':>12}{'dynrel':>8}{'size KiB':>10}{'dlopen us':>11}")
+    try:
+        loader = work / "loader"
+        (work / "loader.cpp").write_text(LOADER, encoding="utf-8")
+        run([args.cxx, "-O2", work / "loader.cpp", "-o", loader, "-ldl"])
+        for name, inc, defs, ldflags in variants:
+            obj_dir = work / f"obj-{name}"
+            obj_dir.mkdir()
+            flags = ["-std=c++20", "-O2", "-fPIC", f"-I{inc}", *defs, *args.extra]
+            objs = [obj_dir / (s.stem + ".o") for s in sources]
+            with ThreadPoolExecutor(max_workers=os.cpu_count() or 1) as pool:
+                list(pool.map(lambda so: run([args.cxx, *flags, "-c", so[0], "-o", so[1]]), zip(sources, objs)))
+
+            lib = work / f"lib{name}.so"
+            link = [args.cxx, "-shared", "-fPIC", *ldflags, *args.extra, *objs, "-o", lib]
+            best = None
+            for _ in range(max(1, args.runs)):
+                t0 = time.perf_counter()
+                run(link)
+                ms = (time.perf_counter() - t0) * 1000.0
+                best = ms if best is None else min(best, ms)
+
+            dynsym, dynrel = junk_dynsyms(lib), dyn_relocs(lib)
+            size = lib.stat().st_size / 1024.0
+            # one dlopen per process: libraries with STB_GNU_UNIQUE symbols are never unloaded,
+            # so a second dlopen in the same process would only find the loaded copy
+            dl = min(float(run([loader, lib, 1]).strip()) for _ in range(max(1, args.runs) * 4))
+            print(f"{name:<12}{best:>9.1f}{dynsym:>12}{dynrel:>8}{size:>10.1f}{dl:>11.1f}")
+    except (subprocess.CalledProcessError, FileNotFoundError) as e:
+        print(f"linkbench: {e}", file=sys.stderr)
+        sys.exit(1)
+    finally:
+        if args.keep:
+            print(f"\nBuild directory: {work}")
+        else:
+            shutil.rmtree(work, ignore_errors=True)
+
+
+if __name__ == "__main__":
+    main()
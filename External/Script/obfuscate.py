@@ -4,24 +4,52 @@ SafeCppObfuscator � ONLY wrap strings used with:
   � std::cout/cerr/clog (via <<)  ? uses OBS_CSTR(...) to keep ostream overloads happy
   � printf-family calls            ? uses OBS/OBS_* by literal prefix
   � Windows MessageBox* calls      ? uses OBS_CSTR(...) for all MessageBox variants
+  � fmt / std::format / spdlog      ? uses OBS_VIEW(...) (stack-decrypted std::string_view)
+  � syslog, and any call named in --sinks-config with its own wrapper choice
 
 Also:
   � Adds #include <Junk.h> and #include <StringObfuscator.h> to sources
   � Braces single-statement if/else bodies
   � Injects junk macros inside function/method/lambda bodies and before return
 
-Dry-run by default; use --write to modify files.
+Everything added or changed is wrapped in /*obf+*/ ... /*obf-*/ markers (replacements
+keep the original in /*obf=...*/), so re-runs replace their earlier output and --strip
+restores the sources.
+
+Dry-run by default; use --write to modify files in place or --out-dir to write a
+transformed copy of the tree.
 
 Usage:
-  python obfuscate.py <project_root> [--write] [--whitelist src Include] [--exclude src/hmac src/SHA] [--debug]
+  python obfuscate.py <project_root> [--write | --out-dir DIR] [--jobs N] [--cache-dir DIR] [--profile perf.txt] [--whitelist src Include] [--exclude src/hmac src/SHA] [--debug]
+  python obfuscate.py <project_root> --compile-commands build/compile_commands.json [--target Obfuscator] [--write | --out-dir DIR]
+  python obfuscate.py <project_root> --sinks-config sinks.json [--write | --out-dir DIR]
+  python obfuscate.py <project_root> --string-table [--seed S] [--write | --out-dir DIR]
+  python obfuscate.py <project_root> --strip [--write | --out-dir DIR]      (remove all injections)
+  python obfuscate.py <project_root> --diff changes.patch          (nothing written; git apply --directory=<project_root>)
+  python obfuscate.py <project_root> --out-dir DIR --watch [--listen PORT]    (then, per build: --sync PORT)
+  python obfuscate.py --emit-junk-pool <dir> [--junk-pool-size 256] [--junk-pool-shards 4]
 """
 
+import hashlib
+import io
+import json
+import os
 import re
 import sys
 import argparse
+import filecmp
+import mmap
 import random
+import select
+import shlex
+import shutil
+import socket
+import tempfile
+import time
+from concurrent.futures import ProcessPoolExecutor, as_completed
+from contextlib import nullcontext, redirect_stdout
 from pathlib import Path
-from typing import Set, Tuple
+from typing import Dict, List, Optional, Set, Tuple
 
 # ---------------- debug helpers ----------------
 DEBUG = False
@@ -39,221 +67,292 @@ def _sanitize_preview(s: str, max_len: int = 80) -> str:
         return one_line[:max_len-3] + '...'
     return one_line
 
-def _line_col_from_pos(text: str, pos: int) -> Tuple[int, int]:
-    # 1-based line/column
-    line = text.count('\n', 0, pos) + 1
-    last_nl = text.rfind('\n', 0, pos)
-    col = pos - (last_nl + 1) + 1
-    return line, col
-
-# ---------------- generic helpers ----------------
-def _skip_ws(s, i):
-    n = len(s)
-    while i < n and s[i].isspace():
-        i += 1
-    return i
+# ---------------- tokenizer ----------------
+# One pass over the file yields (kind, text) tokens whose texts concatenate back to the
+# original; every transform below is a stage over that token list.
+#   pp   whole preprocessor line incl. continuations    nl    line break
+#   ws   horizontal whitespace                          lcom  // comment   bcom /* comment */
+#   str  "..." with prefix    raw  R"d(...)d" with prefix    chr  '...'
+#   id   identifier/keyword   num  pp-number                 op   '::' '->' '<<' or one char
+# stage_annotations adds: off / offop (tokens of an OBF:off region) and hint (trivia
+# carrying a function's junk level; its text is dropped from the output).
+_TOKEN_RE = re.compile(r'''
+    (?P<pp>   ^[ \t]*\#(?:\\\r?\n|[^\r\n]|\r(?!\n))* )
+  | (?P<nl>   \r?\n )
+  | (?P<ws>   (?:[ \t\f\v]|\r(?!\n))+ )
+  | (?P<lcom> //[^\r\n]* )
+  | (?P<bcom> /\*.*?\*/ )
+  | (?P<raw>  (?:u8|[uUL])?R"(?P<delim>[^()\\\s"]{0,16})\(.*?\)(?P=delim)" )
+  | (?P<str>  (?:u8|[uUL])?"(?:\\\r\n|\\.|[^"\\\r\n])*" )
+  | (?P<chr>  (?:u8|[uUL])?'(?:\\.|[^'\\\r\n])*' )
+  | (?P<id>   [A-Za-z_$][\w$]* )
+  | (?P<num>  \.?\d(?:[eEpP][+-]|[\w.'])* )
+  | (?P<op>   ::|->|<<|. )
+''', re.VERBOSE | re.MULTILINE | re.DOTALL)
 
-def _is_ident_char(ch):
-    return ch.isalnum() or ch == '_'
+_SPACE   = frozenset(('ws', 'nl'))
+_TRIVIA  = frozenset(('ws', 'nl', 'lcom', 'bcom', 'hint'))
+_OPS     = frozenset(('op', 'offop'))   # 'offop': operator inside an OBF:off region
+_LITERAL = frozenset(('str', 'raw'))
+_OPEN    = frozenset('([{')
+_CLOSE   = frozenset(')]}')
 
-def _read_ident(s, i):
-    n = len(s)
-    j = i
-    if j < n and (s[j].isalpha() or s[j] == '_'):
-        j += 1
-        while j < n and (s[j].isalnum() or s[j] == '_'):
-            j += 1
-        return s[i:j], j
-    return "", i
+Token = Tuple[str, str]
+
+def tokenize(text: str) -> List[Token]:
+    return [(m.lastgroup, m.group()) for m in _TOKEN_RE.finditer(text)]
 
-def _bol(s, i):
-    while i > 0 and s[i-1] not in '\r\n':
+def _literal_prefix(tok: Token) -> str:
+    return tok[1][:tok[1].index('"')]
+
+class _LineCounter:
+    # 1-based line/column of token indices, advanced incrementally; for log messages
+    def __init__(self, toks: List[Token]):
+        self.toks, self.i, self.line, self.col = toks, 0, 1, 1
+
+    def at(self, idx: int) -> Tuple[int, int]:
+        if idx < self.i:
+            self.i, self.line, self.col = 0, 1, 1
+        for _, t in self.toks[self.i:idx]:
+            nl = t.count('\n')
+            if nl:
+                self.line += nl
+                self.col = len(t) - t.rfind('\n')
+            else:
+                self.col += len(t)
+        self.i = idx
+        return self.line, self.col
+
+def _prev_sig(toks: List[Token], i: int, skip=_TRIVIA) -> int:
+    # index of the last token before i not in skip (0 if none)
+    i -= 1
+    while i > 0 and toks[i][0] in skip:
         i -= 1
-    return i
+    return max(i, 0)
 
-def _is_preproc_bol(s, pos):
-    b = _bol(s, pos)
-    k = b
-    while k < len(s) and s[k] in ' \t':
-        k += 1
-    return k < len(s) and s[k] == '#'
-
-def _skip_preproc_line(s, i):
-    if not _is_preproc_bol(s, i):
-        return i
-    n = len(s)
-    while i < n:
-        while i < n and s[i] not in '\r\n':
-            i += 1
-        back = i - 1
-        while back >= 0 and s[back] in ' \t':
-            back -= 1
-        if back >= 0 and s[back] == '\\':
-            if i < n and s[i] == '\r': i += 1
-            if i < n and s[i] == '\n': i += 1
-            continue
-        break
-    if i < n and s[i] == '\r': i += 1
-    if i < n and s[i] == '\n': i += 1
+def _next_sig(toks: List[Token], i: int, skip=_TRIVIA) -> int:
+    n = len(toks)
+    while i < n and toks[i][0] in skip:
+        i += 1
     return i
 
-def _scan_to_matching_paren(s, i):
-    n = len(s)
-    if i >= n or s[i] != '(':
-        return -1
+def _match_close(toks: List[Token], i: int) -> int:
+    # toks[i] is an opening bracket; index of its partner or -1
     depth = 0
-    while i < n:
-        ch = s[i]
-        # // comment
-        if ch == '/' and i+1 < n and s[i+1] == '/':
-            i += 2
-            while i < n and s[i] != '\n':
-                i += 1
+    for j in range(i, len(toks)):
+        kind, t = toks[j]
+        if kind not in _OPS:
             continue
-        # /* */ comment
-        if ch == '/' and i+1 < n and s[i+1] == '*':
-            i += 2
-            while i+1 < n and not (s[i] == '*' and s[i+1] == '/'):
-                i += 1
-            i += 2
-            continue
-        # string/char
-        if ch in ('"', "'"):
-            q = ch
-            i += 1
-            while i < n:
-                if s[i] == '\\':
-                    i += 2
-                    continue
-                if s[i] == q:
-                    i += 1
-                    break
-                i += 1
-            continue
-        if ch == '(':
+        if t in _OPEN:
             depth += 1
-            i += 1
-            continue
-        if ch == ')':
+        elif t in _CLOSE:
             depth -= 1
-            i += 1
             if depth == 0:
-                return i - 1
-            continue
-        i += 1
+                return j
     return -1
 
-def _scan_simple_stmt_end(s, i):
-    n = len(s)
-    dp = db = dc = 0
+def _line_indent_at(toks: List[Token], i: int) -> Optional[str]:
+    # indentation of toks[i] when it is the first token on its line, else None
+    prev = toks[i-1][0] if i > 0 else 'nl'
+    if prev == 'nl':
+        return ''
+    if prev == 'ws' and (i == 1 or toks[i-2][0] == 'nl'):
+        return toks[i-1][1]
+    return None
+
+def _line_indent(toks: List[Token], i: int) -> str:
+    while i > 0 and toks[i-1][0] != 'nl':
+        i -= 1
+    return toks[i][1] if toks[i][0] == 'ws' else ''
+
+# Annotation comments and attributes (stage_annotations)
+_OBF_COMMENT_RE = re.compile(r'(?://|/\*)\s*OBF:\s*(off|on|level\s*=\s*(full|light|none))\b')
+_HINT_LEVELS    = {'full': 'full', 'light': 'light', 'none': 'skip'}
+_OBF_ATTRIBUTES = frozenset(('hot', 'no_junk'))
+
+def _obf_attribute(toks: List[Token], i: int) -> Tuple[int, Optional[str]]:
+    # toks[i] is '['; (index past '[[obf::<name>]]', name) or (0, None)
+    want = ['[', 'obf', '::', None, ']', ']']
+    j = i + 1
+    name = None
+    for w in want:
+        j = _next_sig(toks, j, _SPACE)
+        if j >= len(toks):
+            return 0, None
+        t = toks[j][1]
+        if w is None:
+            if t not in _OBF_ATTRIBUTES:
+                return 0, None
+            name = t
+        elif t != w:
+            return 0, None
+        j += 1
+    return j, name
+
+# Statements whose body may end in '}' rather than ';'
+_COMPOUND_HEADS = frozenset(('for', 'while', 'switch', 'if', 'try'))
+
+def _stmt_end(toks: List[Token], i: int) -> int:
+    """
+    Index of the last token (';' or closing '}') of the statement starting at toks[i],
+    or -1 when it does not end inside the current block. A trailing 'else' / 'catch'
+    stays with the statement while it owns an unmatched 'if' / the 'try'.
+    """
+    n = len(toks)
+    compound = i < n and toks[i][1] in _COMPOUND_HEADS
+    depth = 0
+    open_ifs = 0
     while i < n:
-        ch = s[i]
-        if ch == '/' and i+1 < n and s[i+1] == '/':
-            i += 2
-            while i < n and s[i] != '\n':
-                i += 1
-            continue
-        if ch == '/' and i+1 < n and s[i+1] == '*':
-            i += 2
-            while i+1 < n and not (s[i] == '*' and s[i+1] == '/'):
-                i += 1
-            i += 2
-            continue
-        if ch in ('"', "'"):
-            q = ch
-            i += 1
-            while i < n:
-                if s[i] == '\\':
-                    i += 2
-                    continue
-                if s[i] == q:
-                    i += 1
-                    break
-                i += 1
-            continue
-        if ch == '(':
-            dp += 1
-        elif ch == ')':
-            dp = max(0, dp-1)
-        elif ch == '[':
-            db += 1
-        elif ch == ']':
-            db = max(0, db-1)
-        elif ch == '{':
-            dc += 1
-        elif ch == '}':
-            dc = max(0, dc-1)
-        elif ch == ';' and dp == db == dc == 0:
-            return i
+        kind, t = toks[i]
+        if kind == 'id' and depth == 0:
+            if t == 'if':
+                open_ifs += 1
+            elif t == 'else':
+                open_ifs -= 1
+        elif kind in _OPS:
+            if t in _OPEN:
+                depth += 1
+            elif t in _CLOSE:
+                depth -= 1
+                if depth < 0:
+                    return -1
+            if depth == 0 and (t == ';' or (t == '}' and compound)):
+                nxt = _next_sig(toks, i + 1)
+                follow = toks[nxt][1] if nxt < n else ''
+                if not ((follow == 'else' and open_ifs > 0) or follow == 'catch'):
+                    return i
         i += 1
     return -1
 
-def brace_single_line_if_else_safe(content, indent_with="    ", passes=1):
-    s = content
-    for _ in range(max(1, passes)):
-        n = len(s)
-        i = 0
-        out = []
-        changed = False
-        def leading_indent(pos):
-            b = _bol(s, pos)
-            j = b
-            while j < n and s[j] in ' \t':
-                j += 1
-            return s[b:j]
-        while i < n:
-            if _is_preproc_bol(s, i):
-                ni = _skip_preproc_line(s, i)
-                out.append(s[i:ni])
-                i = ni
-                continue
-            if s.startswith('if', i) and (i+2 == len(s) or not _is_ident_char(s[i+2])):
-                j = _skip_ws(s, i+2)
-                if j < n and s[j] == '(':
-                    close = _scan_to_matching_paren(s, j)
-                    if close != -1:
-                        k = _skip_ws(s, close+1)
-                        if k < n and s[k] == '{':
-                            out.append(s[i:k]); i = k; continue
-                        end = _scan_simple_stmt_end(s, k)
-                        if end != -1:
-                            indent = leading_indent(i)
-                            body = s[k:end].rstrip()
-                            out.append(s[i:k]); out.append('{')
-                            out.append('\n' + indent + indent_with + (body if body.endswith(';') else body + ';'))
-                            out.append('\n' + indent + '}')
-                            i = end + 1; changed = True; continue
-            if s.startswith('else', i) and (i+4 == len(s) or not _is_ident_char(s[i+4])):
-                j = _skip_ws(s, i+4)
-                if s.startswith('if', j) and (j+2 == len(s) or not _is_ident_char(s[j+2])):
-                    out.append(s[i:j]); i = j; continue
-                if j < n and s[j] == '{':
-                    out.append(s[i:j]); i = j; continue
-                end = _scan_simple_stmt_end(s, j)
-                if end != -1:
-                    indent = leading_indent(i)
-                    body = s[j:end].rstrip()
-                    out.append(s[i:j]); out.append('{')
-                    out.append('\n' + indent + indent_with + (body if body.endswith(';') else body + ';'))
-                    out.append('\n' + indent + '}')
-                    i = end + 1; changed = True; continue
-            out.append(s[i]); i += 1
-        joined = ''.join(out)
-        if not changed:
-            return joined
-        s = joined
-    return s
+# ---------------- injection markers ----------------
+# Output of the stages is emitted with every run of added or changed tokens marked:
+#   /*obf+*/NEW/*obf-*/        inserted
+#   /*obf+*/NEW/*obf=OLD*/     replaced; OLD escaped ('@' -> '@@', '*/' -> '*@/')
+# transform strips them before anything else, so a re-run replaces its earlier output, and
+# --strip gives back the sources byte for byte.
+_MARK_OPEN = '/*obf+*/'
+_MARK_RE = re.compile(r'/\*obf\+\*/.*?/\*obf(?:-|=(.*?))\*/', re.S)
 
-# ---------- literal helpers ----------
-_STRING_PREFIXES = ('u8R"', 'LR"', 'uR"', 'UR"', 'u8"', 'L"', 'u"', 'U"', 'R"', '"')
+def strip_markers(text: str) -> Tuple[str, int]:
+    return _MARK_RE.subn(lambda m: re.sub(r'@([@/])', r'\1', m.group(1) or ''), text)
+
+def _mark_changes(orig: List[Token], toks: List[Token]) -> str:
+    # Text of toks with each run of tokens not taken from orig (by identity), together with
+    # the originals dropped at that point, marked; runs are trimmed to the differing tokens
+    index = {id(t): i for i, t in enumerate(orig)}
+    parts: List[str] = []
+    new: List[str] = []
+    pos = 0
+
+    def flush(old: List[str]):
+        a = 0
+        while a < len(new) and a < len(old) and new[a] == old[a]:
+            a += 1
+        b = 0
+        while b < len(new) - a and b < len(old) - a and new[-1-b] == old[-1-b]:
+            b += 1
+        parts.extend(new[:a])
+        mid_new, mid_old = ''.join(new[a:len(new)-b]), ''.join(old[a:len(old)-b])
+        if mid_new == mid_old:
+            parts.append(mid_new)       # same text from other tokens: nothing to mark
+        elif mid_new or mid_old:
+            old_text = mid_old.replace('@', '@@').replace('*/', '*@/')
+            parts.append(_MARK_OPEN + mid_new + (f'/*obf={old_text}*/' if mid_old else '/*obf-*/'))
+        parts.extend(new[len(new)-b:])
+        new.clear()
+
+    for tok in toks:
+        j = index.get(id(tok), -1)
+        if j < pos:
+            new.append(tok[1])
+            continue
+        flush([t for _, t in orig[pos:j]])
+        parts.append(tok[1])
+        pos = j + 1
+    flush([t for _, t in orig[pos:]])
+    return ''.join(parts)
+
+def _marked_after(text: bytes, marked: bool) -> bool:
+    # Whether text (a comment or preprocessor line) leaves a marked run open
+    opened, closed = text.rfind(b'/*obf+*/'), max(text.rfind(b'/*obf-*/'), text.rfind(b'/*obf='))
+    return marked if opened == closed else opened > closed
+
+# Byte-level scanner for _stream_chunks: skips everything that may contain braces or ';'
+# without being code, and reports '{' '}' ';'.
+_SPLIT_RE = re.compile(rb'''
+    (?P<skip>  ^[ \t]*\#(?:\\\r?\n|[^\r\n])*
+             | //[^\r\n]* | /\*.*?\*/
+             | (?:u8|[uUL])?R"(?P<delim>[^()\\\s"]{0,16})\(.*?\)(?P=delim)"
+             | (?:u8|[uUL])?"(?:\\\r\n|\\.|[^"\\\r\n])*" | '(?:\\.|[^'\\\r\n])*'
+             | [A-Za-z_$][\w$]* | \.?\d(?:[eEpP][+-]|[\w.'])* )
+  | (?P<open> \{ ) | (?P<close> \} ) | (?P<semi> ; )
+''', re.VERBOSE | re.MULTILINE | re.DOTALL)
+_TRANSPARENT_RE = re.compile(rb'(?:\bnamespace\b[^;{}()]*|\bextern\s*"C(?:\+\+)?"\s*)$')
+
+def _stream_chunks(buf, chunk_bytes: int):
+    """
+    (start, end) byte ranges covering buf, each cut right after a ';' or '}' that ends a
+    top-level declaration once chunk_bytes is reached. namespace / extern "C" braces do not
+    count as nesting, so amalgamated files wrapped in a namespace still split. Never inside
+    a marked run, which transform must see whole to strip it.
+    """
+    start = last = 0
+    depth = 0
+    opened = []          # per open '{': True when it is a namespace / extern "C" block
+    marked = False
+    for m in _SPLIT_RE.finditer(buf):
+        g = m.lastgroup
+        if g == 'skip' and b'/*obf' in m.group():
+            marked = _marked_after(m.group(), marked)
+        if g == 'open':
+            ns = depth == 0 and _TRANSPARENT_RE.search(buf[max(last, m.start() - 512):m.start()]) is not None
+            opened.append(ns)
+            depth += not ns
+        elif g == 'close':
+            if opened:
+                depth -= not opened.pop()
+        elif g != 'semi':
+            continue
+        last = m.end()
+        if g != 'open' and depth == 0 and not marked and last - start >= chunk_bytes:
+            yield start, last
+            start = last
+    if start < len(buf):
+        yield start, len(buf)
+
+class FileContext:
+    """Per-file state shared by the stages."""
+    __slots__ = ('path', 'rel', 'is_src', 'newline', 'counts', 'bodies', 'loops', 'head', 'off', 'sites',
+                 'streamed', 'strtab', 'orig')
 
-def _classify_prefix(s, pos):
-    for p in _STRING_PREFIXES:
-        if s.startswith(p, pos):
-            is_raw = p.endswith('R"') or p == 'R"'
-            return (p[:-1] if p != '"' else ''), pos + len(p), is_raw, True
-    return None, pos, False, False
+    def __init__(self, path: Path, is_src: bool, rel: str = ''):
+        self.path = path
+        self.rel = rel or path.name     # project-relative path, part of every junk site identity
+        self.is_src = is_src
+        self.newline = '\n'
+        self.head = True        # the text starts the file (streamed files: the first chunk)
+        self.off = False        # inside an OBF:off region (carried across streamed chunks)
+        self.streamed = False   # transformed in chunks by _process_streamed
+        self.strtab: Optional['StringTable'] = None   # --string-table records of this file
+        self.orig: List[Token] = []     # tokens of the input text, before any stage
+        self.counts = {'functions_obfuscated': 0, 'returns_obfuscated': 0, 'strings_wrapped': 0,
+                       'hot_functions': 0, 'returns_hoisted': 0, 'loop_skipped': 0, 'strings_tabled': 0,
+                       'injections_stripped': 0, 'strings_kept': 0}
+        # In the token list the function stage returns:
+        # (index of '{', index of '}', hot action or None, per-iteration lambda, junk budget
+        # units, site) of every function/lambda body, and (index of the keyword, first index,
+        # last index) of every for/while/do body
+        self.bodies: List[Tuple[int, int, Optional[str], bool, int, str]] = []
+        self.loops: List[Tuple[int, int, int]] = []
+        self.sites: Dict[str, int] = {}
 
+    def site(self, key: str) -> str:
+        # Stable identity of a junk site: key plus its ordinal among equal keys in this file
+        n = self.sites.get(key, 0)
+        self.sites[key] = n + 1
+        return f'{key}#{n}'
+
+# ---------- literal helpers ----------
 def _macro_for_prefix(pfx):
     return {
         '':   'OBS',
@@ -268,48 +367,141 @@ def _macro_for_prefix(pfx):
         'UR': 'OBS_RU32',
     }.get(pfx, 'OBS')
 
-def _collect_one_literal(s, i, pfx, is_raw):
-    n = len(s)
-    if is_raw:
-        delim = ''
-        j = i
-        while j < n and s[j] != '(':
-            delim += s[j]; j += 1
-        term = ')' + delim + '"'
-        if j < n and s[j] == '(':
-            j += 1
-        while j < n:
-            if s.startswith(term, j):
-                return j + len(term), term
-            j += 1
-        return n, term
-    else:
-        j = i
-        while j < n:
-            ch = s[j]
-            if ch == '\\' and j+1 < n:
-                j += 2
-                continue
-            if ch == '"':
-                return j + 1, None
-            j += 1
-        return j, None
+def _wrap_macro(how, pfx):
+    """
+    For iostream chains and MessageBox*, prefer C-string so the overloads are unambiguous:
+    narrow prefixes (every MessageBox* literal) -> OBS_CSTR. Others by prefix.
+    """
+    if how == 'msgbox' or (how == 'iostream' and pfx in {'', 'u8', 'R', 'u8R'}):
+        return 'OBS_CSTR'
+    return _macro_for_prefix(pfx)
+
+# ---------- --string-table ----------
+# The layers of StringObfuscator.h's ObfuscateString, computed here so the compiler only sees
+# ciphertext; DecryptBytes there is the inverse. Keep the two in step (OBF_STRING_TABLE_VERIFY
+# makes the generated tables check themselves against ObfuscateString).
+_M32, _M64 = 0xFFFFFFFF, 0xFFFFFFFFFFFFFFFF
 
-def _wrap_group_text(group_text, pfx):
-    return f"{_macro_for_prefix(pfx)}({group_text})"
+def _mix32(x: int) -> int:
+    x ^= (x << 13) & _M32; x ^= x >> 17; x ^= (x << 5) & _M32
+    return x
 
-def _wrap_iostream_group_text(group_text, pfx):
+def string_key(seed: int, n: int) -> int:
+    return _mix32((seed * 0x9E3779B1 + n) & _M32)
+
+def _rotl8(v: int, r: int) -> int:
+    r &= 7
+    return ((v << r) | (v >> ((8 - r) & 7))) & 0xFF
+
+def encrypt_literal(data: bytes, seed: int) -> bytes:
+    # ObfuscateString<len(data), seed>: data includes the terminator
+    n, k = len(data), string_key(seed, len(data))
+    key1 = ((k * 0x100000001B3) & _M64) ^ 0xDEADBEEF
+    key2 = ((k * 0x1000000001B3) & _M64) ^ 0xCAFEBABE
+    out = bytearray((c ^ (key1 >> (i * 8 % 56)) ^ (key2 >> (i * 3 % 56))) & 0xFF for i, c in enumerate(data))
+    base = k % 7 + 1
+    out = bytearray(_rotl8(c, (base + i) % 7 + 1) ^ (0xAA if i % 2 == 0 else 0x55) for i, c in enumerate(out))
+    for i in range(n - 1, 0, -1):
+        j = ((k * (i + 1)) & _M64) % (i + 1)
+        out[i], out[j] = out[j], out[i]
+    out = bytearray(((c + 13) & 0xFF) ^ 42 for c in out)
+    out = bytearray(_rotl8(~(c ^ ((k + i) & 0xFF)) & 0xFF, 6) for i, c in enumerate(out))
+    return bytes(((197 * c + 101) & 0xFF) ^ 0xA5 ^ (i * 139 & 0xFF) for i, c in enumerate(out))
+
+_SIMPLE_ESCAPES = {'n': 10, 't': 9, 'r': 13, 'v': 11, 'f': 12, 'a': 7, 'b': 8,
+                   '\\': 92, "'": 39, '"': 34, '?': 63}
+_ESCAPE_RE = re.compile(r'\\(?:([0-7]{1,3})|x([0-9A-Fa-f]+)|u([0-9A-Fa-f]{4})|U([0-9A-Fa-f]{8})|(\r?\n)|(.))', re.S)
+
+def _literal_bytes(parts: List[Token]) -> Optional[bytes]:
+    # Bytes (with terminator) of a group of adjacent narrow literals, or None when they are not
+    # plain ASCII apart from \x/octal escapes (the execution charset would matter)
+    out = bytearray()
+    for tok in parts:
+        kind, t = tok
+        if kind not in _LITERAL:
+            continue
+        if _literal_prefix(tok) not in ('', 'R'):
+            return None
+        if kind == 'raw':
+            body = t[t.index('(') + 1:t.rindex(')')]
+            if '\r' in body or not body.isascii():
+                return None
+            out += body.encode()
+            continue
+        body, pos = t[t.index('"') + 1:-1], 0
+        for m in _ESCAPE_RE.finditer(body):
+            plain = body[pos:m.start()]
+            if not plain.isascii():
+                return None
+            out += plain.encode()
+            octal, hexa, u4, u8, splice, other = m.groups()
+            if octal or hexa:
+                v = int(octal, 8) if octal else int(hexa, 16)
+            elif u4 or u8:
+                v = int(u4 or u8, 16)
+                v = v if v < 0x80 else 256
+            elif splice:
+                v = -1
+            else:
+                v = _SIMPLE_ESCAPES.get(other, 256)
+            if v > 0xFF:
+                return None
+            if v >= 0:
+                out.append(v)
+            pos = m.end()
+        if not body[pos:].isascii():
+            return None
+        out += body[pos:].encode()
+    return bytes(out) + b'\0'
+
+class StringTable:
     """
-    For iostream chains, prefer C-string so operator<< is unambiguous.
-    Narrow prefixes -> OBS_CSTR(...). Others fall back to generic wrapper.
+    Encrypted narrow literals of one TU (--string-table). The records go into one blob defined
+    at the end of the file and declared after #include <StringObfuscator.h>; sites become
+    OBS_TBL*(table, offset, N, key) references. Equal literals share a record.
     """
-    if pfx in {'', 'u8', 'R', 'u8R'}:
-        return f"OBS_CSTR({group_text})"
-    return _wrap_group_text(group_text, pfx)
+    _MACROS = {'OBS': 'OBS_TBL', 'OBS_R': 'OBS_TBL', 'OBS_CSTR': 'OBS_TBL_CSTR', 'OBS_VIEW': 'OBS_TBL_VIEW'}
+
+    def __init__(self, rel: str, seed: Optional[str]):
+        self.name = 'obf_strtab_' + hashlib.sha1(rel.encode()).hexdigest()[:8]
+        self.rel, self.seed = rel, seed
+        self.blob = bytearray()
+        self.records: Dict[bytes, Tuple[int, int, str]] = {}   # plaintext -> (offset, SEED, literal text)
+        self.declared = False
 
-# MessageBox* ? ALWAYS OBS_CSTR(...) per request
-def _wrap_msgbox_group_text(group_text, pfx, fname):
-    return f"OBS_CSTR({group_text})"
+    def ref(self, macro: str, parts: List[Token]) -> Optional[str]:
+        # Table reference replacing macro(parts), or None to keep the constexpr macro
+        tbl = self._MACROS.get(macro)
+        data = _literal_bytes(parts) if tbl else None
+        if data is None:
+            return None
+        rec = self.records.get(data)
+        if rec is None:
+            if self.seed is None:
+                seed = random.getrandbits(32)
+            else:
+                seed = int.from_bytes(hashlib.sha256(f'{self.seed}\0{self.rel}\0'.encode() + data).digest()[:4], 'little')
+            rec = (len(self.blob), seed, ''.join(t for _, t in parts))
+            self.blob += encrypt_literal(data, seed)
+            self.records[data] = rec
+        return f'{tbl}({self.name}, {rec[0]}, {len(data)}, {string_key(rec[1], len(data)):#010x}u)'
+
+    def declaration(self) -> str:
+        return f'[[maybe_unused]] static const unsigned char* {self.name}() noexcept;'
+
+    def definition(self, nl: str) -> str:
+        blob = self.blob or b'\0'
+        lines = ['', f'// obfuscate.py --string-table: {len(self.records)} encrypted literal(s) of this file',
+                 f'static constexpr unsigned char {self.name}_blob[] = {{']
+        lines += ['    ' + ', '.join(f'0x{b:02x}' for b in blob[i:i+16]) + ',' for i in range(0, len(blob), 16)]
+        lines += ['};', f'static const unsigned char* {self.name}() noexcept {{ return {self.name}_blob; }}']
+        if self.records:
+            lines.append('#ifdef OBF_STRING_TABLE_VERIFY')
+            lines += [f'static_assert(::StringObfuscator::TableRecordMatches<sizeof({lit}), {seed:#010x}u>('
+                      f'{lit}, {self.name}_blob + {off}), "string table record at {off}");'
+                      for off, seed, lit in self.records.values()]
+            lines.append('#endif')
+        return nl.join(lines) + nl
 
 # ---------- targeted wrappers ----------
 _IOSTREAM_STREAMS = {'std::cout', 'std::cerr', 'std::clog', 'cout', 'cerr', 'clog'}
@@ -320,288 +512,1030 @@ _WIN_MSGBOX_FUNCS = {
     'MessageBoxTimeoutA', 'MessageBoxTimeoutW',
 }
 
-def wrap_only_iostream_printf_msgbox(text: str) -> str:
+# Logging/formatting calls whose string literals are wrapped: name -> (wrap, format, fmt_arg)
+#   wrap     prefix  OBS/OBS_W/... by literal prefix      (every literal inside the call)
+#            cstr    OBS_CSTR                              (every literal inside the call)
+#            view    OBS_VIEW, a std::string_view into a stack buffer wiped after the call
+#                    (narrow literals that are a whole argument)
+#   format   view sinks: how the format-string literal is passed -- 'runtime' (fmt::runtime(...)),
+#            'vformat' (call rewritten onto std::vformat/vformat_to, inside a lambda that binds
+#            the arguments when they are not plain lvalues) or 'keep' (left in plaintext,
+#            compile-time checked); literals left unwrapped are logged as [kept]
+#   fmt_arg  view sinks: the format string is the first whole literal at an index <= fmt_arg
+#            (fmt::print(stderr, "..."), spdlog::log(level, "..."))
+# Qualified names are matched as written; 'std::x' also matches an entry 'x'.
+SinkSpec = Tuple[str, Optional[str], int]
+_SINK_WRAPS   = ('prefix', 'cstr', 'view')
+_SINK_FORMATS = (None, 'runtime', 'vformat', 'keep')
+DEFAULT_SINKS: Dict[str, SinkSpec] = {
+    **{f: ('prefix', None, 0) for f in _PRINTF_FUNCS},
+    **{f: ('cstr', None, 0) for f in _WIN_MSGBOX_FUNCS},
+    'syslog': ('cstr', None, 0),
+    **{f'fmt::{f}': ('view', 'runtime', 1) for f in ('print', 'println', 'format_to')},
+    'fmt::format': ('view', 'runtime', 0),
+    'std::format': ('view', 'vformat', 0),
+    'std::format_to': ('view', 'vformat', 1),
+    **{f'std::{f}': ('view', 'vformat', 1) for f in ('print', 'println')},
+    **{f'spdlog::{f}': ('view', 'runtime', 0) for f in ('trace', 'debug', 'info', 'warn', 'error', 'critical')},
+    'spdlog::log': ('view', 'runtime', 2),
+}
+
+def load_sinks(path: Path) -> Dict[str, SinkSpec]:
+    """
+    DEFAULT_SINKS merged with a JSON object {name: {"wrap": ..., "format": ..., "fmt_arg": n}};
+    null removes a built-in sink. Raises ValueError on unknown wrappers or formats.
+    """
+    sinks = dict(DEFAULT_SINKS)
+    for name, spec in json.loads(path.read_text(encoding='utf-8')).items():
+        if spec is None:
+            sinks.pop(name, None)
+            continue
+        wrap = spec.get('wrap', 'cstr')
+        fmt = spec.get('format', 'runtime' if wrap == 'view' else None)
+        if wrap not in _SINK_WRAPS or fmt not in _SINK_FORMATS:
+            raise ValueError(f"sink {name!r}: wrap must be one of {_SINK_WRAPS}, format one of {_SINK_FORMATS[1:]}")
+        sinks[name] = (wrap, fmt, int(spec.get('fmt_arg', 0)))
+    return sinks
+
+def _literal_group_end(toks: List[Token], i: int, limit: int) -> int:
+    # toks[i] is a literal; extend over adjacent literals (whitespace between), up to limit
+    j = i + 1
+    while True:
+        k = _next_sig(toks, j, _SPACE)
+        if k < limit and toks[k][0] in _LITERAL:
+            j = k + 1
+            continue
+        return j
+
+def _simple_stmt_end(toks: List[Token], i: int) -> int:
+    depth = 0
+    for j in range(i, len(toks)):
+        kind, t = toks[j]
+        if kind not in _OPS:
+            continue
+        if t in _OPEN:
+            depth += 1
+        elif t in _CLOSE:
+            depth = max(0, depth - 1)
+        elif t == ';' and depth == 0:
+            return j
+    return len(toks) - 1
+
+def _call_args(toks: List[Token], k: int, close: int) -> List[Tuple[int, int]]:
+    # [start, end) token ranges of the top-level arguments of the call whose '(' is toks[k]
+    args: List[Tuple[int, int]] = []
+    start, depth = k + 1, 0
+    for j in range(k + 1, close):
+        kind, t = toks[j]
+        if kind not in _OPS:
+            continue
+        if t in _OPEN:
+            depth += 1
+        elif t in _CLOSE:
+            depth -= 1
+        elif t == ',' and depth == 0:
+            args.append((start, j)); start = j + 1
+    if args or _next_sig(toks, start) < close:
+        args.append((start, close))
+    return args
+
+def stage_wrap_strings(toks: List[Token], ctx: FileContext,
+                       sinks: Dict[str, SinkSpec] = DEFAULT_SINKS) -> List[Token]:
     """
     Wrap string literals only in:
       - insertion chains that start with std::cout/cerr/clog (literals after '<<') ? OBS_CSTR
-      - printf-family calls (any literal args inside (...))                       ? OBS/OBS_*
-      - MessageBox* calls (any literal args inside (...))                         ? OBS_CSTR
+      - calls of a sink in `sinks` (DEFAULT_SINKS: printf family ? OBS/OBS_*, MessageBox* and
+        syslog ? OBS_CSTR, fmt/std::format/spdlog ? OBS_VIEW)
     """
-    s = text
-    n = len(s)
+    out: List[Token] = []
+    n = len(toks)
     i = 0
-    out = []
-    changed = False
-    in_line = False
-    in_block = False
-    in_char = False
-
-    def at_stream_start(idx):
-        j = idx
-        name, j2 = _read_ident(s, j)
-        if name == 'std':
-            j = j2
-            if j < n and s[j] == ':' and j+1 < n and s[j+1] == ':':
-                j += 2
-                name2, j3 = _read_ident(s, j)
-                if name2:
-                    return 'std::' + name2, j3
-            return '', idx
-        elif name:
-            return name, j2
-        return '', idx
+    where = _LineCounter(toks) if DEBUG else None
 
-    while i < n:
-        ch = s[i]
+    def wrap(k: int, limit: int, how: str, macro: Optional[str] = None, outer: str = '{}') -> int:
+        g = _literal_group_end(toks, k, limit)
+        p = _prev_sig(toks, k)
+        if toks[p][1] == '(' and toks[_prev_sig(toks, p)][1].startswith('OBS'):
+            out.extend(toks[k:g])       # already an OBS*(...) argument
+            return g
+        group = ''.join(t for _, t in toks[k:g])
+        macro = macro or _wrap_macro(how, _literal_prefix(toks[k]))
+        ref = ctx.strtab.ref(macro, toks[k:g]) if ctx.strtab is not None else None
+        out.append(('obs', outer.format(ref or f'{macro}({group})')))
+        ctx.counts['strings_wrapped'] += 1
+        if ref:
+            ctx.counts['strings_tabled'] += 1
+        if DEBUG:
+            line, col = where.at(k)
+            _dbg(f"   [wrap] {how:<9} {CURRENT_FILE}:{line}:{col}  {_sanitize_preview(group)}")
+        return g
 
-        # comments
-        if in_line:
-            out.append(ch)
-            if ch == '\n':
-                in_line = False
-            i += 1
-            continue
-        if in_block:
-            out.append(ch)
-            if ch == '*' and i+1 < n and s[i+1] == '/':
-                out.append('/')
-                i += 2
-                in_block = False
+    kept_at: Optional[Tuple[_LineCounter, Dict[int, int]]] = None
+
+    def kept(k: int, name: str, reason: str):
+        # a literal a sink call leaves in clear text; the position is taken from the input
+        # tokens, as earlier stages inserted lines
+        nonlocal kept_at
+        ctx.counts['strings_kept'] += 1
+        if DEBUG:
+            if kept_at is None:
+                kept_at = (_LineCounter(ctx.orig), {id(t): j for j, t in enumerate(ctx.orig)})
+            line, col = kept_at[0].at(kept_at[1].get(id(toks[k]), 0))
+            _dbg(f"   [kept] {CURRENT_FILE}:{line}:{col}  {name}: {reason}  {_sanitize_preview(toks[k][1])}")
+
+    def wrap_view_call(name: str, i: int, name_end: int, k: int, close: int, spec: SinkSpec):
+        """
+        OBS_VIEW for whole-literal arguments. A std::string_view is not a format string, so
+        the format argument becomes fmt::runtime(...) ('runtime') or the call is rewritten
+        onto the type-erased API ('vformat'):
+          f(pre.., F, a..)          -> vf(pre.., F', make_format_args(a..))     f: format, format_to
+          print(pre.., F, a..)      -> print(pre.., "{}", vformat(F', make_format_args(a..)))
+        make_format_args only binds lvalues, and a name alone may still be a prvalue (macro,
+        enumerator, true), so a call with arguments a.. is wrapped in a capture-less generic
+        lambda whose named parameters bind them:
+          [](auto&& p0.., auto&&... a) { return <call on p0.., a...>; }(pre.., a..)
+        """
+        _, fmt_mode, fmt_arg = spec
+        args = _call_args(toks, k, close)
+        whole: Dict[int, int] = {}     # argument index -> its literal
+        for idx, (a, b) in enumerate(args):
+            s = _next_sig(toks, a)
+            if s < b and toks[s][0] in _LITERAL and _literal_prefix(toks[s]) in {'', 'u8', 'R', 'u8R'} \
+                    and _next_sig(toks, _literal_group_end(toks, s, b)) >= b:
+                whole[idx] = s
+        fmt_idx = next((idx for idx in sorted(whole) if idx <= fmt_arg), None)
+        if fmt_mode == 'vformat' and fmt_idx is None:
+            fmt_mode = 'keep'
+        wrapped: Set[int] = set()
+
+        def emit_arg(idx: int, j: int) -> int:
+            # tokens of argument idx from j on, with its whole literal wrapped; returns the new j
+            a, b = args[idx]
+            s = whole.get(idx, _next_sig(toks, a))
+            out.extend(toks[j:s])
+            if idx not in whole or (idx == fmt_idx and fmt_mode == 'keep'):
+                return s
+            wrapped.add(s)
+            return wrap(s, b, name, 'OBS_VIEW', 'fmt::runtime({})' if idx == fmt_idx and fmt_mode == 'runtime' else '{}')
+
+        if fmt_mode != 'vformat':
+            out.extend(toks[i:k+1])
+            j = k + 1
+            for idx in range(len(args)):
+                j = emit_arg(idx, j)
+            out.extend(toks[j:close])
+        else:
+            qual = ''.join(t for _, t in toks[i:name_end-1])
+            last = toks[name_end-1][1]
+            rest = args[fmt_idx+1:]
+            if last in ('print', 'println'):
+                callee, inner = qual + last, qual + 'vformat('
             else:
-                i += 1
-            continue
+                callee, inner = qual + 'v' + last, ''
 
-        # start comment
-        if ch == '/' and i+1 < n and s[i+1] == '/':
-            out.append('//'); i += 2; in_line = True; continue
-        if ch == '/' and i+1 < n and s[i+1] == '*':
-            out.append('/*'); i += 2; in_block = True; continue
-
-        # char literal
-        if not in_char and ch == "'":
-            out.append(ch); i += 1; in_char = True; continue
-        if in_char:
-            if ch == '\\' and i+1 < n:
-                out.append(s[i:i+2]); i += 2; continue
-            out.append(ch); i += 1
-            if ch == "'":
-                in_char = False
-            continue
+            tail = ')' + (')' if inner else '')     # closes make_format_args [and vformat]
+
+            def wrap_fmt():
+                s = whole[fmt_idx]
+                wrapped.add(s)
+                wrap(s, args[fmt_idx][1], name, 'OBS_VIEW')
+                out.append(('obs', ', std::make_format_args('))
+
+            if not rest:
+                if callee == qual + last:
+                    out.extend(toks[i:name_end])
+                else:
+                    out.append(('obs', callee))
+                out.extend(toks[name_end:k+1])
+                j = k + 1
+                for idx in range(fmt_idx):
+                    j = emit_arg(idx, j)
+                out.extend(toks[j:args[fmt_idx][0]])
+                if inner:
+                    out.append(('obs', '"{}", ' + inner))
+                wrap_fmt()
+                out.append(('obs', tail))
+            else:
+                params = [f'auto&& obf_p{n}' for n in range(fmt_idx)] + ['auto&&... obf_a']
+                pre = ''.join(f'obf_p{n}, ' for n in range(fmt_idx))
+                out.append(('obs', f"[]({', '.join(params)}) {{ return {callee}({pre}"
+                                   + ('"{}", ' + inner if inner else '')))
+                wrap_fmt()
+                out.append(('obs', 'obf_a...' + tail + '); }'))
+                out.extend(toks[name_end:k+1])       # '(' of the original call now invokes the lambda
+                j = k + 1
+                for idx in range(fmt_idx):
+                    j = emit_arg(idx, j)
+                # the format argument and the comma after it are dropped
+                out.extend(toks[j:args[fmt_idx][0]])
+                out.extend(toks[rest[0][0]:close])
 
-        # preprocessor line
-        if _is_preproc_bol(s, i):
-            start = i
-            while i < n and s[i] not in '\r\n':
-                out.append(s[i]); i += 1
-            if i < n and s[i] == '\r': out.append('\r'); i += 1
-            if i < n and s[i] == '\n': out.append('\n'); i += 1
+        for idx, (a, b) in enumerate(args):
+            for s in range(a, b):
+                p = _prev_sig(toks, s)
+                if toks[s][0] in _LITERAL and s not in wrapped and (p < a or toks[p][0] not in _LITERAL) \
+                        and not (toks[p][1] == '(' and toks[_prev_sig(toks, p)][1].startswith('OBS')):
+                    reason = ('format string (format: keep)' if fmt_mode == 'keep' and idx == fmt_idx
+                              else 'not a whole narrow literal argument' if idx not in whole or whole[idx] != s
+                              else 'not the format argument')
+                    kept(s, name, reason)
+
+    while i < n:
+        kind, t = toks[i]
+        if kind != 'id' or (out and out[-1][1] in ('.', '->')):   # member calls are not sinks
+            out.append(toks[i]); i += 1
             continue
 
+        # qualified name: ns::ns::f
+        name_end = i + 1
+        while name_end + 1 < n and toks[name_end][1] == '::' and toks[name_end+1][0] == 'id':
+            t += '::' + toks[name_end+1][1]
+            name_end += 2
+
         # ---- iostream chains ----
-        name, pos_after = at_stream_start(i)
-        if name in _IOSTREAM_STREAMS:
-            out.append(s[i:pos_after]); i = pos_after
-            stmt_end = _scan_simple_stmt_end(s, i)
-            if stmt_end == -1: stmt_end = n - 1
-            j = i
-            while j <= stmt_end:
-                if j + 1 <= stmt_end and s[j] == '<' and s[j+1] == '<':
-                    out.append('<<'); j += 2
-                    k = _skip_ws(s, j)
-                    pfx, nextpos, is_raw, opened = _classify_prefix(s, k)
-                    if opened:
-                        lit_end, _ = _collect_one_literal(s, nextpos, pfx, is_raw)
-                        j2 = lit_end
-                        # adjacent literals
-                        while True:
-                            ws = j2
-                            while ws <= stmt_end and s[ws].isspace():
-                                ws += 1
-                            p2, n2, r2, o2 = _classify_prefix(s, ws)
-                            if o2:
-                                lit_end2, _ = _collect_one_literal(s, n2, p2, r2)
-                                j2 = lit_end2
-                                continue
-                            break
-                        group_text = s[k:j2]
-                        out.append(_wrap_iostream_group_text(group_text, pfx))
-                        changed = True
-                        if DEBUG:
-                            line, col = _line_col_from_pos(s, k)
-                            _dbg(f"   [wrap] iostream  {CURRENT_FILE}:{line}:{col}  {_sanitize_preview(group_text)}")
-                        j = j2
-                        continue
-                    else:
-                        out.append(s[j:k]); j = k; continue
-                out.append(s[j]); j += 1
+        if t in _IOSTREAM_STREAMS:
+            out.extend(toks[i:name_end])
+            end = _simple_stmt_end(toks, name_end)
+            j = name_end
+            while j <= end:
+                if toks[j][1] == '<<' and toks[j][0] == 'op':
+                    out.append(toks[j])
+                    k = _next_sig(toks, j + 1, _SPACE)
+                    out.extend(toks[j+1:k])
+                    j = wrap(k, end + 1, 'iostream') if k <= end and toks[k][0] in _LITERAL else k
+                    continue
+                out.append(toks[j]); j += 1
             i = j
             continue
 
-        # ---- printf-family & MessageBox* calls ----
-        ident, id_end = _read_ident(s, i)
-        if ident in _PRINTF_FUNCS or ident in _WIN_MSGBOX_FUNCS:
-            k = _skip_ws(s, id_end)
-            if k < n and s[k] == '(':
-                out.append(s[i:k+1])  # up to '(' inclusive
-                paren_end = _scan_to_matching_paren(s, k)
+        # ---- sink calls ----
+        spec = sinks.get(t) or (sinks.get(t[5:]) if t.startswith('std::') else None)
+        if spec:
+            k = _next_sig(toks, name_end, _SPACE)
+            close = _match_close(toks, k) if k < n and toks[k][1] == '(' else -1
+            if close != -1 and spec[0] == 'view':
+                wrap_view_call(t, i, name_end, k, close, spec)
+                i = close
+                continue
+            if close != -1:
+                how = 'msgbox' if spec[0] == 'cstr' else 'printf'
+                out.extend(toks[i:k+1])
                 j = k + 1
-                while j <= paren_end:
-                    if s[j].isspace():
-                        out.append(s[j]); j += 1; continue
-                    pfx, nxt, is_raw, opened = _classify_prefix(s, j)
-                    if opened:
-                        lit_end, _ = _collect_one_literal(s, nxt, pfx, is_raw)
-                        j2 = lit_end
-                        # include adjacent literals
-                        while True:
-                            ws = j2
-                            while ws <= paren_end and s[ws].isspace():
-                                ws += 1
-                            p2, n2, r2, o2 = _classify_prefix(s, ws)
-                            if o2:
-                                lit_end2, _ = _collect_one_literal(s, n2, p2, r2)
-                                j2 = lit_end2
-                                continue
-                            break
-                        group = s[j:j2]
-                        if ident in _WIN_MSGBOX_FUNCS:
-                            wrapped = _wrap_msgbox_group_text(group, pfx, ident)
-                            out.append(wrapped)
-                            if DEBUG:
-                                line, col = _line_col_from_pos(s, j)
-                                _dbg(f"   [wrap] msgbox    {CURRENT_FILE}:{line}:{col}  {_sanitize_preview(group)}")
-                        else:
-                            wrapped = _wrap_group_text(group, pfx)
-                            out.append(wrapped)
-                            if DEBUG:
-                                line, col = _line_col_from_pos(s, j)
-                                _dbg(f"   [wrap] printf    {CURRENT_FILE}:{line}:{col}  {_sanitize_preview(group)}")
-                        changed = True
-                        j = j2
+                while j < close:
+                    if toks[j][0] in _LITERAL:
+                        j = wrap(j, close, how)
                         continue
-                    out.append(s[j]); j += 1
-                i = paren_end + 1
+                    out.append(toks[j]); j += 1
+                i = close
                 continue
 
-        # default
-        out.append(ch); i += 1
+        out.extend(toks[i:name_end]); i = name_end
+    return out
+
+def _stat_snapshot(files: List[Path]) -> Dict[Path, Tuple[int, int]]:
+    # (mtime_ns, size) per existing file, what --watch compares between scans
+    state = {}
+    for p in files:
+        try:
+            st = p.stat()
+        except OSError:
+            continue
+        state[p] = (st.st_mtime_ns, st.st_size)
+    return state
+
+# ---------------- result cache (--cache-dir) ----------------
+class ResultCache:
+    """
+    Transform results keyed by sha256 of this script, the transform options, the file
+    kind and the file contents. Entries are JSON files under <dir>/<2 hex>/, written via
+    rename so parallel workers can share a directory. Streamed files keep their output
+    in a '.out' file next to the entry instead of inside the JSON.
+    """
+    def __init__(self, root: Path, options: Dict):
+        self.root = root
+        salt = hashlib.sha256(Path(__file__).read_bytes())
+        salt.update(json.dumps(options, sort_keys=True).encode())
+        self.salt = salt.digest()
+
+    def key(self, kind: str, text) -> str:
+        # text: str, or the raw bytes of a streamed file (bytes / mmap, hashed in place)
+        h = hashlib.sha256(self.salt)
+        h.update(kind.encode() + b'\0')
+        h.update(text.encode('utf-8', 'surrogatepass') if isinstance(text, str) else text)
+        return h.hexdigest()
+
+    def _path(self, key: str) -> Path:
+        return self.root / key[:2] / (key[2:] + '.json')
+
+    def get(self, key: str, orig: str) -> Optional[Tuple[str, Dict[str, int]]]:
+        try:
+            entry = json.loads(self._path(key).read_text(encoding='utf-8'))
+            out = entry['out']
+            return (orig if out is None else out), entry['counts']
+        except Exception:
+            return None
+
+    def put(self, key: str, orig: str, out: str, counts: Dict[str, int]):
+        path = self._path(key)
+        try:
+            path.parent.mkdir(parents=True, exist_ok=True)
+            tmp = path.with_suffix(f'.{os.getpid()}.tmp')
+            tmp.write_text(json.dumps({'out': None if out == orig else out, 'counts': counts}), encoding='utf-8')
+            os.replace(tmp, path)
+        except Exception as e:
+            print(f"   cache write failed: {e}")
+
+    def get_file(self, key: str) -> Optional[Tuple[Optional[Path], Dict[str, int]]]:
+        # (stored output, or None when the file was left unchanged; counts)
+        try:
+            path = self._path(key)
+            entry = json.loads(path.read_text(encoding='utf-8'))
+            out = path.with_suffix('.out') if entry['changed'] else None
+            if out is not None and not out.is_file():
+                return None
+            return out, entry['counts']
+        except Exception:
+            return None
+
+    def put_file(self, key: str, out: Optional[Path], counts: Dict[str, int]):
+        path = self._path(key)
+        try:
+            path.parent.mkdir(parents=True, exist_ok=True)
+            tmp = path.with_suffix(f'.{os.getpid()}.tmp')
+            if out is not None:
+                shutil.copyfile(out, tmp)
+                os.replace(tmp, path.with_suffix('.out'))
+            tmp.write_text(json.dumps({'changed': out is not None, 'counts': counts}), encoding='utf-8')
+            os.replace(tmp, path)
+        except Exception as e:
+            print(f"   cache write failed: {e}")
 
-    return ''.join(out) if changed else text
+# ---------------- sampling profile (--profile) ----------------
+def _profile_symbol(sym: str) -> str:
+    # 'int ns::Foo<int>::bar(int) const+0x1c' -> 'ns::Foo::bar'; lambdas count towards their function
+    sym = re.sub(r'\+0x[0-9a-fA-F]+$', '', sym.split('::{lambda', 1)[0])
+    out, depth, i = [], 0, 0
+    while i < len(sym):
+        ch = sym[i]
+        if ch == '(' and depth == 0:
+            if not ''.join(out).endswith('operator'):
+                break                                   # argument list: the name is complete
+            i += 2                                      # 'operator()' is labelled 'operator' here too
+            continue
+        if ch == '<' and not ''.join(out).endswith('operator'):
+            depth += 1
+        elif ch == '>' and depth:
+            depth -= 1
+        elif depth == 0:
+            out.append(ch)
+        i += 1
+    name = ''.join(out).strip()
+    return name.split()[-1] if name else ''
+
+class HotProfile:
+    """
+    Self-sample share (percent) per function from `perf script` output (samples of an
+    indented callchain, leaf first) or folded stacks ('a;b;leaf 123').
+    """
+    def __init__(self, path: Path):
+        counts: Dict[str, int] = {}
+        text = path.read_text(encoding='utf-8', errors='replace')
+        lines = text.splitlines()
+        if any(l[:1] in (' ', '\t') for l in lines[:200]):
+            leaf_next = False
+            for line in lines:
+                if not line.strip():
+                    leaf_next = False
+                elif line[0] not in ' \t':
+                    leaf_next = True                      # sample header
+                elif leaf_next:
+                    parts = line.split(None, 1)
+                    sym = parts[1].rsplit(' (', 1)[0] if len(parts) == 2 else ''
+                    counts[sym] = counts.get(sym, 0) + 1
+                    leaf_next = False
+        else:
+            for line in lines:
+                stack, _, n = line.rpartition(' ')
+                if stack and n.isdigit():
+                    leaf = re.sub(r'_\[[kjwi]\]$', '', stack.rsplit(';', 1)[-1])
+                    counts[leaf] = counts.get(leaf, 0) + int(n)
+        total = sum(counts.values()) or 1
+        self.by_short: Dict[str, List[Tuple[str, float]]] = {}
+        merged: Dict[str, float] = {}
+        for sym, c in counts.items():
+            key = _profile_symbol(sym)
+            if key and not key.startswith('['):
+                merged[key] = merged.get(key, 0.0) + 100.0 * c / total
+        for key, pct in merged.items():
+            self.by_short.setdefault(key.rsplit('::', 1)[-1], []).append((key, pct))
+        self.digest = hashlib.sha256(text.encode('utf-8', 'surrogatepass')).hexdigest()
+
+    def share(self, label: str) -> float:
+        # 'Foo::bar' matches 'ns::Foo::bar'; an unqualified 'bar' matches every 'bar'
+        q = label.lstrip(':')
+        return sum(pct for key, pct in self.by_short.get(q.rsplit('::', 1)[-1], ())
+                   if '::' not in q or key == q or key.endswith('::' + q))
+
+# ---------------- compile_commands.json (--compile-commands) ----------------
+_INCLUDE_RE = re.compile(r'^[ \t]*#[ \t]*include[ \t]*([<"])([^>"\r\n]+)[>"]', re.MULTILINE)
+_INC_FLAGS = ('-iquote', '-isystem', '-idirafter', '-I', '/I')
+
+def _compile_db_entries(db_path: Path, target: Optional[str]):
+    """(source file, [include dirs]) per entry; target keeps only CMakeFiles/<target>.dir/ objects."""
+    marker = f'CMakeFiles/{target}.dir/' if target else None
+    for entry in json.loads(db_path.read_text(encoding='utf-8')):
+        directory = Path(entry.get('directory', '.'))
+        if 'arguments' in entry:
+            args = list(entry['arguments'])
+        else:
+            args = [a.strip('"') for a in shlex.split(entry.get('command', ''), posix=False)]
+        if marker:
+            where = (entry.get('output') or ' '.join(args)).replace('\\', '/')
+            if marker not in where:
+                continue
+        dirs = []
+        i = 0
+        while i < len(args):
+            a = args[i]
+            for flag in _INC_FLAGS:
+                if a.startswith(flag):
+                    rest = a[len(flag):]
+                    if not rest and i + 1 < len(args):
+                        i += 1
+                        rest = args[i]
+                    if rest:
+                        dirs.append(directory / rest)
+                    break
+            i += 1
+        yield directory / entry['file'], dirs
+
+def _resolve_include(name: str, quoted: bool, includer: Path, dirs: List[Path]) -> Optional[Path]:
+    for d in ([includer.parent] if quoted else []) + dirs:
+        cand = d / name
+        if cand.is_file():
+            return cand.resolve()
+    return None
 
 # ---------------- obfuscator core ----------------
 class SafeCppObfuscator:
-    def __init__(self, junk_header="Junk.h", obf_header="StringObfuscator.h"):
+    def __init__(self, junk_header="Junk.h", obf_header="StringObfuscator.h", max_header_tokens=256):
         self.junk_header = junk_header
         self.obf_header  = obf_header
-        self.stats = {'functions_obfuscated':0,'returns_obfuscated':0,'strings_wrapped':0,'files_processed':0}
+        self.stats = {'functions_obfuscated':0,'returns_obfuscated':0,'strings_wrapped':0,'strings_tabled':0,'injections_stripped':0,'strings_kept':0,'files_processed':0,'cache_hits':0,'hot_functions':0,'returns_hoisted':0,'loop_skipped':0}
         self.SRC_EXTS = {'.cpp','.cxx','.cc','.c'}
         self.HDR_EXTS = {'.h','.hpp','.hxx','.hh'}
+        # Junk sites and their relative runtime cost in budget units, cheapest first
         self.junk_macros = [
-            "JUNK_CODE_BLOCK();",
-            "JUNK_CODE_BLOCK_ADVANCED();",
-            "JUNK_CODE_BLOCK(); JUNK_CODE_BLOCK();",
-            "JUNK_CODE_BLOCK_ADVANCED(); JUNK_CODE_BLOCK_ADVANCED();",
+            ("JUNK_CODE_BLOCK();", 1),
+            ("JUNK_CODE_BLOCK_ADVANCED();", 2),
         ]
+        self.work_per_unit = 8        # estimated body work (statements + 3 per call) per budget unit
+        self.max_units = 6            # budget cap of a single function
         self.exclude_functions = {'malloc','free','new','delete','operatornew','operatordelete'}
-        self.function_pattern = re.compile(r'''( (?: (?:[A-Za-z_]\w*\s+)+ [A-Za-z_]\w* ) \s*\([^)]*\)\s*(?:const\s*)?(?:noexcept\s*)?(?:override\s*)?\s*\{ )''', re.VERBOSE | re.MULTILINE)
-        self.method_pattern   = re.compile(r'''( (?:[A-Za-z_]\w*::)+ ~?[A-Za-z_]\w* \s*\([^)]*\)\s*(?:const\s*)?(?:noexcept\s*)?(?:override\s*)?\s*\{ )''', re.VERBOSE | re.MULTILINE)
-        self.lambda_pattern   = re.compile(r'''( \[[^\]]*\]\s*\([^)]*\)\s*(?:mutable\s*)?(?:noexcept\s*)?(?:->\s*[^{]*)?\s*\{ )''', re.VERBOSE | re.MULTILINE)
-        self.return_pattern   = re.compile(r'(^[ \t]*)return\s+([^;]+);', re.MULTILINE)
-
-    def _should_obf_fn(self, decl: str) -> bool:
-        m = re.search(r'(\w+)\s*\(', decl)
-        if m and m.group(1) in self.exclude_functions:
+        self.max_header_tokens = max_header_tokens
+        self.cache: Optional[ResultCache] = None
+        self.profile: Optional[HotProfile] = None
+        self.hot_threshold = 1.0      # percent of samples
+        self.hot_action = 'light'     # 'light' (JUNK_INLINE_BYTES only) or 'skip'
+        self.stream_bytes = 1 << 20           # files larger than this are transformed in chunks
+        self.stream_chunk_bytes = 256 << 10   # target chunk size when streaming
+        self.seed: Optional[str] = None       # --seed: junk choice derived per site instead of random
+        self.sinks: Dict[str, SinkSpec] = DEFAULT_SINKS   # calls whose literals are wrapped (--sinks-config)
+        self.string_table = False             # --string-table: script-encrypted per-TU literal tables
+        self.strip = False                    # --strip: only remove earlier injections
+        self.diff: Optional[List[str]] = None  # --diff: unified diffs of changed files, in path order
+        self.src_root: Optional[Path] = None    # set by process_tree
+        self.out_dir: Optional[Path] = None
+        # (selected files, mirrored ones, their (mtime, size), compile db's) before process_tree
+        self.first_pass: Optional[Tuple[List[Path], Set[Path], Dict[Path, Tuple[int, int]], Dict[Path, Tuple[int, int]]]] = None
+
+    def cache_options(self) -> Dict:
+        # Everything besides the file contents and this script that shapes the output
+        return {
+            'junk_header': self.junk_header, 'obf_header': self.obf_header,
+            'junk_macros': self.junk_macros, 'exclude_functions': sorted(self.exclude_functions),
+            'max_header_tokens': self.max_header_tokens,
+            'work_per_unit': self.work_per_unit, 'max_units': self.max_units,
+            'profile': self.profile.digest if self.profile else None,
+            'hot_threshold': self.hot_threshold, 'hot_action': self.hot_action, 'seed': self.seed,
+            'sinks': sorted(self.sinks.items()), 'string_table': self.string_table, 'strip': self.strip,
+        }
+
+    def _should_obf_fn(self, name: str, decl: str) -> bool:
+        if name in self.exclude_functions:
             return False
         return len(decl.strip()) >= 20
 
-    def _junk(self) -> str:
-        j = random.choice(self.junk_macros)
-        if random.random() < 0.2:
-            j += " " + random.choice(self.junk_macros)
-        return j
+    def _junk_units(self, toks: List[Token], i: int) -> Tuple[int, int, int]:
+        # (statements, calls, budget units) of the body opened by toks[i]
+        close = _match_close(toks, i)
+        stmts = calls = 0
+        prev = ''
+        for kind, t in toks[i+1:close if close != -1 else len(toks)]:
+            if kind in _TRIVIA:
+                continue
+            if t == ';' or t in _COMPOUND_HEADS:
+                stmts += 1
+            elif t == '(' and prev not in self._NOT_FUNCTIONS and prev:
+                calls += 1
+            prev = t if kind == 'id' else ''
+        units = 1 + (stmts + 3 * calls) // self.work_per_unit
+        return stmts, calls, min(units, self.max_units)
+
+    def _junk(self, units: int = 1, site: str = '') -> str:
+        # Random sites whose costs add up to the budget; with --seed the choice depends only
+        # on the seed and the site identity
+        rng = random.Random(f'{self.seed}\0{site}') if self.seed is not None else random
+        picks = []
+        while units > 0:
+            macro, cost = rng.choice([m for m in self.junk_macros if m[1] <= units])
+            picks.append(macro)
+            units -= cost
+        return ' '.join(picks)
+
+    # ---- stages ----
+    # Identifiers that may precede '(' ... '{' without naming a function
+    _NOT_FUNCTIONS   = frozenset(('if', 'for', 'while', 'switch', 'catch', 'return', 'sizeof', 'decltype'))
+    _LOOP_HEADS      = frozenset(('for', 'while'))
+    _TAIL_QUALIFIERS = frozenset(('const', 'volatile', 'noexcept', 'override', 'final', 'mutable', 'throw', '&'))
+
+    def _hot_action(self, label: str, stack) -> Optional[str]:
+        if not label:
+            # lambdas follow the innermost enclosing body
+            return next((e[2][1] for e in reversed(stack) if e[2] is not None), None)
+        if self.profile is None:
+            return None
+        share = self.profile.share(label)
+        if share < self.hot_threshold:
+            return None
+        print(f"   [hot] {label}: {share:.2f}% of samples -> {self.hot_action}")
+        return self.hot_action
 
-    def _obf_fn_body(self, m: re.Match) -> str:
-        decl = m.group(1)
-        if not self._should_obf_fn(decl):
-            return decl
-        self.stats['functions_obfuscated'] += 1
-        return decl + "\n    " + self._junk() + "\n"
-
-    def _obf_returns(self, s: str) -> str:
-        def repl(m: re.Match) -> str:
-            indent, expr = m.group(1), m.group(2)
-            self.stats['returns_obfuscated'] += 1
-            return f"{indent}{self._junk()}\n{indent}return {expr};"
-        return self.return_pattern.sub(repl, s)
-
-    def _add_header(self, content: str, header: str, insert_if_missing=True) -> str:
+    def stage_function_bodies(self, toks: List[Token], ctx: FileContext) -> List[Token]:
+        """
+        Junk at the top of function, method and lambda bodies, found in one forward pass:
+          function  'a b name(...) {'   (two or more whitespace-separated identifiers)
+          method    'a::b::~name(...) {'
+          lambda    '[...](...) {'
+        The bracket stack carries a header candidate from its '(' to the matching ')'.
+        The only lookahead is the qualifier / trailing-return tail between ')' and '{'.
+        Headers longer than max_header_tokens tokens are skipped. An annotation hint before
+        the body decides its level; otherwise functions hot in the --profile get
+        hot_action. Lambdas passed as call arguments or defined inside a
+        loop run per element / per iteration and get nothing. Every body is recorded in
+        ctx.bodies and every for/while/do body in ctx.loops.
+        """
+        cap = self.max_header_tokens
+        out: List[Token] = []
+        stack = []           # (opener index, (head, label) or None, (out index, hot action, per-iteration,
+                             #  budget units) or None, (loop keyword, out index) when it opens a loop header/body)
+        run_start, run_ids, qualified = -1, 0, False
+        chain_start = -1     # start of the 'a::b::~c' part of the run
+        prev, name = '', ''  # prev: 'id', '::', '~', ']' or '' -- how the current run ends
+        tail = None          # (head, label, stack depth) between a candidate's ')' and its '{'
+        arrow = False        # tail is inside a trailing return type
+        body = None          # set when the current '{' opens a function body
+        loop_kw = None       # out index of a 'for' / 'while' whose '(' comes next
+        loop_next = None     # out index of a loop keyword whose body starts at the next token
+        loop_brace = None    # set when the current '{' opens a loop body
+        do_tail = False      # the previous token ended a do-loop body: 'while' is its tail
+        stmt_loops = []      # (keyword, first out index, last token index) of unbraced loop bodies
+        hint = None          # (action, stack depth) from stage_annotations, for the next body
+        where = _LineCounter(toks) if DEBUG else None
+
+        def close_bracket(t: str):
+            opener, cand, opened, loop = stack.pop()
+            if opened is not None:
+                ctx.bodies.append((opened[0], len(out) - 1) + opened[1:])
+            if loop is not None and t != ')':
+                ctx.loops.append((loop[0], loop[1], len(out) - 1))
+            return opener, cand, loop
+
+        for i, tok in enumerate(toks):
+            out.append(tok)
+            kind, t = tok
+            if kind in _TRIVIA:
+                if kind == 'hint':
+                    hint = (t, len(stack))
+                continue
+            if hint is not None and len(stack) < hint[1]:
+                hint = None
+            if kind == 'off' or kind == 'offop':
+                # OBF:off region: keep brackets balanced, nothing else
+                tail, prev, loop_kw, loop_next = None, '', None, None
+                if t in _OPEN:
+                    stack.append((i, None, None, None))
+                elif t in _CLOSE and stack:
+                    close_bracket(t)
+                continue
+
+            hdr_kw, loop_kw = loop_kw, None
+            after_do, do_tail = do_tail, False
+            if loop_next is not None:
+                if t == '{':
+                    loop_brace = loop_next
+                elif t != ';':
+                    end = _stmt_end(toks, i)
+                    if end != -1:
+                        stmt_loops.append((loop_next, len(out) - 1, end))
+                loop_next = None
+            while stmt_loops and stmt_loops[-1][2] == i:
+                kw = stmt_loops.pop()
+                ctx.loops.append((kw[0], kw[1], len(out) - 1))
+                do_tail = out[kw[0]][1] == 'do'
+
+            if tail is not None:
+                head, fn, depth = tail
+                if i - head > cap:
+                    _dbg(f"   [skip] header over {cap} tokens  {CURRENT_FILE}:{where.at(head)[0]}")
+                    tail = None
+                elif len(stack) > depth:
+                    pass                                    # inside noexcept(...) / decltype(...)
+                elif t == '{':
+                    per_iteration = not fn and (stmt_loops or any(
+                        e[3] is not None or toks[e[0]][1] == '(' for e in stack))
+                    if hint is not None and hint[1] == len(stack):
+                        action = hint[0]
+                        _dbg(f"   [hint] {fn or 'lambda'} -> {action}")
+                    else:
+                        action = 'skip' if per_iteration else self._hot_action(fn, stack)
+                    if action == 'full':
+                        action, per_iteration = None, False
+                    hint = None
+                    units = 0
+                    if action is None:
+                        stmts, calls, units = self._junk_units(toks, i)
+                        if DEBUG:
+                            _dbg(f"   [budget] {fn or 'lambda'}: {stmts} statements, {calls} calls -> {units} units")
+                    outer = next((e[2][4] for e in reversed(stack) if e[2] is not None), ctx.rel + ':')
+                    site = ctx.site(f'{ctx.rel}:{fn}' if fn else f'{outer}/lambda')
+                    body = (len(out) - 1, action, bool(per_iteration), units, site)
+                    decl = ''.join(x for _, x in toks[head:i+1])
+                    if per_iteration:
+                        ctx.counts['loop_skipped'] += 1
+                        if DEBUG:
+                            _dbg(f"   [loop] no junk in per-iteration lambda  {CURRENT_FILE}:{where.at(i)[0]}")
+                    elif action == 'light' and fn:
+                        ctx.counts['hot_functions'] += 1
+                        out += [('nl', ctx.newline), ('ws', '    '), ('junk', 'JUNK_INLINE_BYTES();'), ('nl', ctx.newline)]
+                    elif action == 'skip' and fn:
+                        ctx.counts['hot_functions'] += 1
+                    elif action is None and self._should_obf_fn(fn.rsplit('::', 1)[-1], decl):
+                        out += [('nl', ctx.newline), ('ws', '    '), ('junk', self._junk(units, site)), ('nl', ctx.newline)]
+                        ctx.counts['functions_obfuscated'] += 1
+                    tail = None
+                elif arrow:
+                    if t == ';' or t == '}':
+                        tail = None
+                elif t == '->':
+                    arrow = True
+                elif t not in self._TAIL_QUALIFIERS and t != '(':
+                    tail = None
+
+            if kind == 'id':
+                if t in self._LOOP_HEADS and not after_do:
+                    loop_kw = len(out) - 1
+                elif t == 'do':
+                    loop_next = len(out) - 1
+                if prev == 'id':
+                    run_ids += 1
+                    chain_start = i
+                elif prev not in ('::', '~'):
+                    run_start, run_ids, qualified, chain_start = i, 1, False, i
+                prev, name = 'id', t
+                continue
+            if t == '::':
+                if prev != 'id':
+                    run_start, run_ids, chain_start = i, 0, i
+                qualified = True
+                prev = '::'
+                continue
+            if t == '~' and prev == '::':
+                prev = '~'
+                continue
+
+            if kind == 'op' and t in _OPEN:
+                cand = None
+                if t == '(' and tail is None:
+                    if prev == 'id' and (qualified or run_ids >= 2) and name not in self._NOT_FUNCTIONS:
+                        label = name if i - chain_start > cap else \
+                            ''.join(x for k, x in toks[chain_start:i] if k not in _TRIVIA)
+                        cand = (run_start, label)
+                    elif prev == ']':
+                        cand = (run_start, '')
+                loop = (hdr_kw, -1) if t == '(' and hdr_kw is not None else \
+                       (loop_brace, len(out) - 1) if t == '{' and loop_brace is not None else None
+                stack.append((i, cand, body if t == '{' else None, loop))
+                body = loop_brace = None
+            elif kind == 'op' and t in _CLOSE and stack:
+                opener, cand, loop = close_bracket(t)
+                if loop is not None:
+                    if t == ')':
+                        loop_next = loop[0]
+                    else:
+                        do_tail = out[loop[0]][1] == 'do'
+                if t == ']':
+                    run_start, prev = opener, ']'
+                    continue
+                if cand is not None and i - cand[0] <= cap:
+                    tail, arrow = (cand[0], cand[1], len(stack)), False
+            if t == ';' and hint is not None and hint[1] == len(stack):
+                hint = None                         # the hint preceded a declaration
+            prev = ''
+        return out
+
+    def stage_annotations(self, toks: List[Token], ctx: FileContext) -> List[Token]:
+        """
+        In-source control, resolved before the other stages:
+          // OBF:off ... // OBF:on          the region is left exactly as written
+          // OBF:level=full|light|none      junk level of the next function body
+          [[obf::hot]]  [[obf::no_junk]]    like a --profile hit / level=none; removed
+                                            from the output
+        Region tokens become 'off' / 'offop' so brackets stay balanced for the scanners;
+        hints become 'hint' trivia that only stage_function_bodies reads.
+        """
+        out: List[Token] = []
+        off = ctx.off
+        n = len(toks)
+        i = 0
+        while i < n:
+            kind, t = toks[i]
+            if kind == 'lcom' or kind == 'bcom':
+                m = _OBF_COMMENT_RE.match(t)
+                out.append(toks[i]); i += 1
+                if m and m.group(1) in ('off', 'on'):
+                    off = m.group(1) == 'off'
+                elif m and not off:
+                    out.append(('hint', _HINT_LEVELS[m.group(2)]))
+                continue
+            if kind == 'op' and t == '[':
+                end, attr = _obf_attribute(toks, i)
+                if end:
+                    if not off:
+                        out.append(('hint', self.hot_action if attr == 'hot' else 'skip'))
+                    i = end + 1 if end < n and toks[end][0] == 'ws' else end
+                    continue
+            if off and kind not in _TRIVIA and kind != 'pp':
+                out.append(('offop' if kind == 'op' else 'off', t))
+            else:
+                out.append(toks[i])
+            i += 1
+        ctx.off = off
+        return out
+
+    def stage_includes(self, toks: List[Token], ctx: FileContext) -> List[Token]:
+        for header in (self.junk_header, self.obf_header):
+            toks = self._add_header(toks, ctx, header, insert_if_missing=ctx.is_src and ctx.head)
+        return toks
+
+    def _add_header(self, toks: List[Token], ctx: FileContext, header: str, insert_if_missing=True) -> List[Token]:
         base = Path(header).name
-        any_inc = re.compile(rf'^\s*#\s*include\s*[<"](?:[^>"/]*/)*{re.escape(base)}[>"]\s*$', re.MULTILINE)
-        content = any_inc.sub(f'#include <{base}>', content)
-        has = re.search(rf'^\s*#\s*include\s*<\s*{re.escape(base)}\s*>\s*$', content, re.MULTILINE)
+        any_inc = re.compile(rf'\s*#\s*include\s*[<"](?:[^>"/]*/)*{re.escape(base)}[>"]\s*$')
+        has_inc = re.compile(rf'\s*#\s*include\s*<\s*{re.escape(base)}\s*>\s*$')
+        canon = f'#include <{base}>'
+        has = False
+        anchor = -1      # last #include / #pragma once of the leading block
+        leading = True
+        for i, (kind, text) in enumerate(toks):
+            if kind != 'pp':
+                if kind not in ('ws', 'nl', 'lcom'):
+                    leading = False
+                continue
+            if any_inc.match(text):
+                toks[i] = ('pp', canon)
+                has = True
+            elif has_inc.match(text):
+                has = True
+            if leading:
+                st = toks[i][1].strip()
+                if st.startswith('#include') or st.startswith('#pragma once'):
+                    anchor = i
+                else:
+                    leading = False
         if has or not insert_if_missing:
-            return content
-        lines = content.splitlines()
-        insert_line = 0
-        for i, line in enumerate(lines):
-            st = line.strip()
-            if st.startswith('#include') or st.startswith('#pragma once'):
-                insert_line = i + 1
-            elif st and not st.startswith('//'):
-                break
-        lines.insert(insert_line, f'#include <{base}>')
-        return '\n'.join(lines)
-
-    def process_file(self, path: Path, *, write=False, max_bytes: int = 524288) -> bool:
+            return toks
+        if anchor >= 0:
+            toks[anchor+1:anchor+1] = [('nl', ctx.newline), ('pp', canon)]
+        else:
+            toks[0:0] = [('pp', canon), ('nl', ctx.newline)]
+        return toks
+
+    def stage_braces(self, toks: List[Token], ctx: FileContext, indent_with="    ") -> List[Token]:
+        # Brace single-statement if/else bodies.
+        out: List[Token] = []
+        n = len(toks)
+        i = 0
+        while i < n:
+            kind, t = toks[i]
+            body = -1
+            if kind == 'id' and t == 'if':
+                j = _next_sig(toks, i + 1)
+                close = _match_close(toks, j) if j < n and toks[j][1] == '(' else -1
+                if close != -1:
+                    body = _next_sig(toks, close + 1)
+            elif kind == 'id' and t == 'else':
+                body = _next_sig(toks, i + 1)
+                if body < n and toks[body][1] == 'if':
+                    out.extend(toks[i:body]); i = body
+                    continue
+            if body == -1 or body >= n:
+                out.append(toks[i]); i += 1
+                continue
+            if toks[body][1] == '{':
+                out.extend(toks[i:body]); i = body
+                continue
+            end = _stmt_end(toks, body)
+            if end == -1:
+                out.extend(toks[i:body]); i = body
+                continue
+            indent = _line_indent(toks, i)
+            out.extend(toks[i:body])
+            out.append(('op', '{'))
+            out.append(('nl', ctx.newline)); out.append(('ws', indent + indent_with))
+            out.extend(toks[body:end+1])
+            out.append(('nl', ctx.newline))
+            if indent:
+                out.append(('ws', indent))
+            out.append(('op', '}'))
+            i = end + 1
+        return out
+
+    def stage_returns(self, toks: List[Token], ctx: FileContext) -> List[Token]:
+        """
+        Junk line before every 'return <expr>' that starts a line, except in hot bodies.
+        A return inside a loop gets its junk once, in front of the outermost loop of its
+        body, so the loop body itself stays untouched; returns of per-iteration lambdas
+        get none.
+        """
+        n = len(toks)
+        bodies = sorted(ctx.bodies)
+        loops = sorted(ctx.loops, key=lambda l: l[1])
+        bi = li = 0
+        active = []          # enclosing bodies, innermost last
+        in_loops = []        # enclosing loop bodies, innermost last
+        here, hoist = {}, {}  # token index -> (budget units, site) of the junk in front of it
+        where = _LineCounter(toks) if DEBUG else None
+        for i, tok in enumerate(toks):
+            while active and active[-1][1] < i:
+                active.pop()
+            while bi < len(bodies) and bodies[bi][0] <= i:
+                active.append(bodies[bi]); bi += 1
+            while in_loops and in_loops[-1][2] < i:
+                in_loops.pop()
+            while li < len(loops) and loops[li][1] <= i:
+                in_loops.append(loops[li]); li += 1
+            if tok[0] != 'id' or tok[1] != 'return' or i + 1 >= n or toks[i+1][0] not in _SPACE:
+                continue
+            nxt = _next_sig(toks, i + 1)
+            if _line_indent_at(toks, i) is None or nxt >= n or toks[nxt][1] == ';':
+                continue
+            fn = active[-1] if active else None
+            if fn is not None and fn[3]:
+                ctx.counts['loop_skipped'] += 1
+                if DEBUG:
+                    _dbg(f"   [loop] no junk at return in per-iteration lambda  {CURRENT_FILE}:{where.at(i)[0]}")
+                continue
+            if fn is not None and fn[2] is not None:
+                continue
+            loop = next((l for l in in_loops if fn is None or l[0] > fn[0]), None)
+            # a call runs the entry junk plus one return's: returns get half the body's budget
+            units = max(1, fn[4] // 2) if fn is not None else 1
+            site = ctx.site((fn[5] if fn is not None else ctx.rel + ':') + '/return')
+            if loop is None:
+                here[i] = (units, site)
+            elif loop[0] not in hoist:
+                hoist[loop[0]] = (units, site)
+                if DEBUG:
+                    _dbg(f"   [loop] return junk hoisted above loop  {CURRENT_FILE}:{where.at(loop[0])[0]}")
+
+        out: List[Token] = []
+        for i, tok in enumerate(toks):
+            if i in here or i in hoist:
+                indent = _line_indent_at(toks, i)
+                out.append(('junk', self._junk(*(here.get(i) or hoist[i]))))
+                if indent is None:
+                    out.append(('ws', ' '))
+                else:
+                    out.append(('nl', ctx.newline))
+                    if indent:
+                        out.append(('ws', indent))
+                ctx.counts['returns_hoisted' if i in hoist else 'returns_obfuscated'] += 1
+            out.append(tok)
+        return out
+
+    def transform(self, txt: str, ctx: FileContext) -> str:
+        bom = ''
+        if txt.startswith('\ufeff'):
+            bom, txt = txt[0], txt[1:]
+        if _MARK_OPEN in txt:
+            # output of an earlier run: start again from the original
+            txt, n = strip_markers(txt)
+            ctx.counts['injections_stripped'] += n      # per chunk when streaming
+        if self.strip:
+            return bom + txt
+        toks = tokenize(txt)
+        orig = ctx.orig = list(toks)
+        if ctx.head:
+            ctx.newline = next((t for kind, t in toks if kind == 'nl'), '\n')
+        ctx.bodies, ctx.loops = [], []
+        if ctx.head and self.string_table and ctx.is_src:
+            ctx.strtab = StringTable(ctx.rel, self.seed)
+        stages = [self.stage_annotations, self.stage_includes]
+        if ctx.is_src:
+            stages += [self.stage_braces, self.stage_function_bodies, self.stage_returns, self.stage_strings,
+                       self.stage_string_table]
+        for stage in stages:
+            toks = stage(toks, ctx)
+        return bom + _mark_changes(orig, [tok for tok in toks if tok[0] != 'hint'])
+
+    def stage_strings(self, toks: List[Token], ctx: FileContext) -> List[Token]:
+        return stage_wrap_strings(toks, ctx, self.sinks)
+
+    def stage_string_table(self, toks: List[Token], ctx: FileContext) -> List[Token]:
+        # Declare the table after #include <StringObfuscator.h> (streamed files always, as later
+        # chunks may need it) and define it at the end; _process_streamed appends it itself.
+        tab = ctx.strtab
+        if tab is None:
+            return toks
+        if ctx.head and (tab.records or ctx.streamed):
+            inc = f'#include <{Path(self.obf_header).name}>'
+            at = next((i + 1 for i, (kind, t) in enumerate(toks) if kind == 'pp' and t.strip() == inc), None)
+            if at is None:
+                toks[0:0] = [('obs', tab.declaration()), ('nl', ctx.newline)]
+            else:
+                toks[at:at] = [('nl', ctx.newline), ('obs', tab.declaration())]
+            tab.declared = True
+        if tab.declared and not ctx.streamed:
+            toks.append(('obs', tab.definition(ctx.newline)))
+        return toks
+
+    def _rel(self, path: Path) -> str:
+        try:
+            return path.resolve().relative_to(self.src_root).as_posix()
+        except (TypeError, ValueError):
+            return path.name
+
+    def _dest_for(self, path: Path) -> Optional[Path]:
+        return self.out_dir / path.relative_to(self.src_root) if self.out_dir else None
+
+    def process_file(self, path: Path, *, write=False, max_bytes: int = 0) -> bool:
         global CURRENT_FILE
+        dest = self._dest_for(path)
         try:
             if path.is_symlink(): return False
-            if path.stat().st_size > max_bytes: return False
+            size = path.stat().st_size
+            if max_bytes and size > max_bytes:
+                if dest is not None:
+                    _copy_if_changed(path, dest)
+                return False
         except Exception:
             return False
 
+        suf = path.suffix.lower()
+        is_src = suf in self.SRC_EXTS
+        if not is_src and suf not in self.HDR_EXTS:
+            return False
+
         CURRENT_FILE = str(path)
         print(f" Processing: {path}")
+        if size > self.stream_bytes:
+            return self._process_streamed(path, FileContext(path, is_src, self._rel(path)), dest, write)
         try:
-            txt = path.read_text(encoding='utf-8', errors='ignore')
+            # --diff keeps line endings so the patch applies to the original bytes
+            with path.open(encoding='utf-8', errors='ignore', newline='' if self.diff is not None else None) as f:
+                orig = f.read()
         except Exception as e:
             print(f"   Skip (read error): {e}")
             return False
 
-        orig = txt
-        s0 = dict(self.stats)
-        suf = path.suffix.lower()
-        is_src = suf in self.SRC_EXTS
-        is_hdr = suf in self.HDR_EXTS
-
-        if is_hdr:
-            txt = self._add_header(txt, self.junk_header, insert_if_missing=False)
-            txt = self._add_header(txt, self.obf_header,  insert_if_missing=False)
-        elif is_src:
-            txt = self._add_header(txt, self.junk_header, insert_if_missing=True)
-            txt = self._add_header(txt, self.obf_header,  insert_if_missing=True)
-            txt = brace_single_line_if_else_safe(txt, passes=1)
-            txt = self.function_pattern.sub(self._obf_fn_body, txt)
-            txt = self.method_pattern.sub(self._obf_fn_body, txt)
-            txt = self.lambda_pattern.sub(self._obf_fn_body, txt)
-            txt = self._obf_returns(txt)
-            wrapped = wrap_only_iostream_printf_msgbox(txt)
-            if wrapped != txt:
-                self.stats['strings_wrapped'] += max(0,
-                    wrapped.count('OBS(')+wrapped.count('OBS_U8(')+wrapped.count('OBS_W(')+
-                    wrapped.count('OBS_U16(')+wrapped.count('OBS_U32(')+wrapped.count('OBS_R(')+
-                    wrapped.count('OBS_RU8(')+wrapped.count('OBS_RW(')+wrapped.count('OBS_RU16(')+
-                    wrapped.count('OBS_RU32(')+wrapped.count('OBS_CSTR(')
-                    - (txt.count('OBS(')+txt.count('OBS_U8(')+txt.count('OBS_W(')+
-                       txt.count('OBS_U16(')+txt.count('OBS_U32(')+txt.count('OBS_R(')+
-                       txt.count('OBS_RU8(')+txt.count('OBS_RW(')+txt.count('OBS_RU16(')+
-                       txt.count('OBS_RU32(')+txt.count('OBS_CSTR(')))
-                txt = wrapped
+        ctx = FileContext(path, is_src, self._rel(path))
+        kind = 'src' if is_src else 'hdr'
+        if self.seed is not None or self.string_table:
+            kind += ':' + ctx.rel       # seeded output and table names depend on the path
+        key = self.cache.key(kind, orig) if self.cache else None
+        hit = self.cache.get(key, orig) if key else None
+        if hit is not None:
+            txt, ctx.counts = hit
+            self.stats['cache_hits'] += 1
+            _dbg("   (cache hit)")
         else:
-            return False
+            txt = self.transform(orig, ctx)
+            if key:
+                self.cache.put(key, orig, txt, ctx.counts)
+        for k, v in ctx.counts.items():
+            self.stats[k] += v
 
+        if dest is not None:
+            # Out-of-tree: always materialize the output, but leave unchanged files untouched
+            try:
+                print(f"   WROTE {dest}" if _write_if_changed(dest, txt) else "   Output up to date")
+            except Exception as e:
+                print(f"   ERROR write: {e}")
+                return False
+            if txt == orig:
+                return False
         if txt != orig:
-            if write:
+            if dest is None and write:
                 try:
                     path.with_suffix(path.suffix + '.bak').write_text(orig, encoding='utf-8')
                     path.write_text(txt, encoding='utf-8')
@@ -609,88 +1543,645 @@ class SafeCppObfuscator:
                 except Exception as e:
                     print(f"   ERROR write: {e}")
                     return False
-            else:
+            elif dest is None and self.diff is not None:
+                self._add_diff(path, orig, txt)
+            elif dest is None:
                 print("   (dry-run) would modify")
-            if is_src:
-                df = self.stats['functions_obfuscated'] - s0['functions_obfuscated']
-                dr = self.stats['returns_obfuscated']   - s0['returns_obfuscated']
-                ds = self.stats['strings_wrapped']      - s0['strings_wrapped']
-                print(f"   Functions:+{df} Returns:+{dr} Strings:+{ds}")
-            self.stats['files_processed'] += 1
-            return True
+            return self._report_changed(ctx)
         else:
             print("   No changes")
             return False
 
-    def process_tree(self, root: Path, *, write=False, max_bytes: int = 524288,
-                     whitelist: Set[str] = None, excludes: Set[str] = None) -> int:
-        processed = 0
-        wl = {w.strip('/\\') for w in (whitelist or {'src', 'Include'})}
-        ex = {e.strip('/\\') for e in (excludes or set())}
-        hard_skip_names = {
-            '.git','.hg','.svn','.vs','.idea','__pycache__','out','build','Build',
-            'CMakeFiles','cmake-build-debug','cmake-build-release','source_backup',
-            'External','third_party','3rdparty'
-        }
+    def _add_diff(self, path: Path, old: str, new: str):
+        self.diff.append(_unified_diff(self._rel(path), old, new))
+        print("   (diff) recorded")
 
-        root = root.resolve()
-        for p in root.rglob('*'):
+    def _report_changed(self, ctx: FileContext) -> bool:
+        if self.strip:
+            print(f"   Stripped:{ctx.counts['injections_stripped']}")
+        elif ctx.is_src:
+            c = ctx.counts
+            print(f"   Functions:+{c['functions_obfuscated']} Returns:+{c['returns_obfuscated']} Strings:+{c['strings_wrapped']}"
+                  f" Hoisted:+{c['returns_hoisted']} LoopSkipped:{c['loop_skipped']}"
+                  + (f" Tabled:{c['strings_tabled']}" if self.string_table else '')
+                  + (f" Kept:{c['strings_kept']}" if c['strings_kept'] else ''))
+        self.stats['files_processed'] += 1
+        return True
+
+    def _process_streamed(self, path: Path, ctx: FileContext, dest: Optional[Path], write: bool) -> bool:
+        """
+        Files over stream_bytes: transformed chunk by chunk over a memory map (chunks end at
+        top-level declarations, see _stream_chunks) and written straight to a temporary file
+        beside the target, so memory follows stream_chunk_bytes instead of the file size.
+        Line endings are kept as they are. The result cache is keyed on the mapped bytes and
+        stores the output file itself.
+        """
+        ctx.streamed = True
+        target = dest if dest is not None else path if write else None
+        tmp = target.with_name(target.name + '.obf-tmp') if target is not None else None
+        if tmp is None and (self.diff is not None or self.cache):
+            fd, name = tempfile.mkstemp(suffix='.obf-tmp')
+            os.close(fd)
+            tmp = Path(name)
+        changed = False
+        try:
+            if tmp is not None:
+                tmp.parent.mkdir(parents=True, exist_ok=True)
+            with open(path, 'rb') as f, mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as mm:
+                kind = f"{'src' if ctx.is_src else 'hdr'}:stream:{self.stream_chunk_bytes}:{ctx.rel}"
+                key = self.cache.key(kind, mm) if self.cache else None
+                hit = self.cache.get_file(key) if key else None
+                if hit is not None:
+                    cached, ctx.counts = hit
+                    changed = cached is not None
+                    shutil.copyfile(cached if changed else path, tmp)
+                    self.stats['cache_hits'] += 1
+                    _dbg("   (cache hit)")
+                else:
+                    with (open(tmp, 'w', encoding='utf-8', newline='') if tmp else nullcontext()) as sink:
+                        for start, end in _stream_chunks(mm, self.stream_chunk_bytes):
+                            text = mm[start:end].decode('utf-8', errors='ignore')
+                            out = self.transform(text, ctx)
+                            ctx.head = False
+                            changed = changed or out != text
+                            if sink is not None:
+                                sink.write(out)
+                        if sink is not None and ctx.strtab is not None and ctx.strtab.declared:
+                            sink.write(_MARK_OPEN + ctx.strtab.definition(ctx.newline) + '/*obf-*/')
+                    if key:
+                        self.cache.put_file(key, tmp if changed else None, ctx.counts)
+            for k, v in ctx.counts.items():
+                self.stats[k] += v
+            if dest is not None:
+                if dest.is_file() and filecmp.cmp(tmp, dest, shallow=False):
+                    tmp.unlink()
+                    print("   Output up to date")
+                else:
+                    os.replace(tmp, dest)
+                    print(f"   WROTE {dest}")
+                if not changed:
+                    return False
+            elif self.diff is not None:
+                if changed:
+                    with path.open(encoding='utf-8', errors='ignore', newline='') as old, \
+                            tmp.open(encoding='utf-8', newline='') as new:
+                        self._add_diff(path, old.read(), new.read())
+                tmp.unlink()
+            elif target is not None:
+                if changed:
+                    shutil.copyfile(path, path.with_suffix(path.suffix + '.bak'))
+                    os.replace(tmp, path)
+                    print("   WROTE (backup .bak created)")
+                else:
+                    tmp.unlink()
+            else:
+                if tmp is not None:
+                    tmp.unlink()              # only written for the cache
+                if changed:
+                    print("   (dry-run) would modify")
+        except Exception as e:
+            print(f"   ERROR stream: {e}")
+            if tmp is not None and tmp.exists():
+                tmp.unlink()
+            return False
+        if changed:
+            return self._report_changed(ctx)
+        print("   No changes")
+        return False
+
+    HARD_SKIP_NAMES = frozenset({
+        '.git','.hg','.svn','.vs','.idea','__pycache__','out','build','Build',
+        'CMakeFiles','cmake-build-debug','cmake-build-release','source_backup',
+        'External','third_party','3rdparty'
+    })
+
+    def collect_files(self, root: Path, *, whitelist: Set[str] = None, excludes: Set[str] = None,
+                      keep_excluded: bool = False) -> Tuple[List[Path], List[Path]]:
+        """
+        Top-down scandir walk from each whitelisted directory: hard-skipped directories are
+        never entered, nor are excluded ones unless keep_excluded (--out-dir mirrors them).
+        Returns (C/C++ files to transform, every other file under the whitelist).
+        """
+        files, others = [], []
+        wl = {w.strip('/\\').replace('\\', '/') for w in (whitelist or {'src', 'Include'})}
+        ex = {e.strip('/\\').replace('\\', '/') for e in (excludes or set())}
+        ex_re = re.compile('|'.join(re.escape(e) for e in sorted(ex))) if ex else None
+        exts = self.SRC_EXTS | self.HDR_EXTS
+        skip = self.HARD_SKIP_NAMES
+
+        def walk(dir_path: str, rel: str, excluded: bool):
             try:
-                if p.is_symlink():
+                with os.scandir(dir_path) as it:
+                    entries = list(it)
+            except OSError:
+                return
+            for e in entries:
+                try:
+                    if e.name in skip or e.is_symlink():
+                        continue
+                    r = rel + e.name
+                    hit = excluded or bool(ex_re and ex_re.search(r))
+                    if e.is_dir(follow_symlinks=False):
+                        if not hit or keep_excluded:
+                            walk(e.path, r + '/', hit)
+                    elif e.is_file(follow_symlinks=False):
+                        p = Path(e.path)
+                        if not hit and os.path.splitext(e.name)[1].lower() in exts:
+                            files.append(p)
+                        else:
+                            others.append(p)
+                except OSError:
                     continue
-            except Exception:
+
+        root = root.resolve()
+        for top in sorted(wl):
+            if not top or any(part in skip for part in top.split('/')):
                 continue
+            start = root / top
+            if start.is_dir() and not start.is_symlink():
+                hit = bool(ex_re and ex_re.search(top))
+                if not hit or keep_excluded:
+                    walk(str(start), top + '/', hit)
+        return sorted(files), sorted(others)
+
+    def collect_from_compile_db(self, root: Path, db_path: Path, *, target: str = None,
+                                excludes: Set[str] = None) -> List[Path]:
+        """
+        The TUs compile_commands.json lists (for target, if given) plus every header they
+        include, transitively, resolved with each TU's include dirs. Only files under root
+        that are not excluded are returned.
+        """
+        root = root.resolve()
+        ex = {e.strip('/\\').replace('\\', '/') for e in (excludes or set())}
+        ex_re = re.compile('|'.join(re.escape(e) for e in sorted(ex))) if ex else None
+
+        def selected(p: Path) -> bool:
             try:
-                rel = p.relative_to(root)
-            except Exception:
-                continue
-            parts = list(rel.parts)
-            if not parts:
-                continue
-            top = parts[0]
-            if wl and top not in wl:
-                continue
-            if any(name in hard_skip_names for name in parts):
-                continue
-            rel_posix = rel.as_posix()
-            if any(seg in rel_posix for seg in (ex or set())):
+                rel = p.relative_to(root).as_posix()
+            except ValueError:
+                return False
+            return not (ex_re and ex_re.search(rel)) and not any(
+                part in self.HARD_SKIP_NAMES for part in rel.split('/'))
+
+        seen: Dict[Path, List[Path]] = {}      # file -> include dirs it was reached with
+        queue = []
+        for src, dirs in _compile_db_entries(db_path, target):
+            src = src.resolve()
+            if src not in seen and selected(src):
+                seen[src] = dirs
+                queue.append(src)
+        while queue:
+            cur = queue.pop()
+            try:
+                text = cur.read_text(encoding='utf-8', errors='ignore')
+            except OSError:
                 continue
-            if p.is_file() and p.suffix.lower() in (self.SRC_EXTS | self.HDR_EXTS):
-                if self.process_file(p, write=write, max_bytes=max_bytes):
-                    processed += 1
+            for m in _INCLUDE_RE.finditer(text):
+                hdr = _resolve_include(m.group(2).strip(), m.group(1) == '"', cur, seen[cur])
+                if hdr is not None and hdr not in seen and selected(hdr):
+                    seen[hdr] = seen[cur]
+                    queue.append(hdr)
+        exts = self.SRC_EXTS | self.HDR_EXTS
+        return sorted(p for p in seen if p.suffix.lower() in exts)
+
+    def select_files(self, root: Path, *, whitelist: Set[str] = None, excludes: Set[str] = None,
+                     out_dir: Path = None, compile_db: Path = None,
+                     target: str = None) -> Tuple[List[Path], List[Path]]:
+        if compile_db is not None:
+            files = self.collect_from_compile_db(root, compile_db, target=target, excludes=excludes)
+            print(f" compile_commands: {len(files)} file(s) selected")
+            return files, []
+        return self.collect_files(root, whitelist=whitelist, excludes=excludes,
+                                  keep_excluded=out_dir is not None)
+
+    def process_tree(self, root: Path, *, write=False, max_bytes: int = 0,
+                     whitelist: Set[str] = None, excludes: Set[str] = None, jobs: int = 1,
+                     out_dir: Path = None, compile_db: Path = None, target: str = None) -> int:
+        files, others = self.select_files(root, whitelist=whitelist, excludes=excludes, out_dir=out_dir,
+                                          compile_db=compile_db, target=target)
+        # --watch starts from the sources as they were before this pass, so a file edited
+        # while it runs is regenerated by the first scan
+        self.first_pass = (files + others, set(others), _stat_snapshot(files + others),
+                           _stat_snapshot([compile_db] if compile_db is not None else []))
+        self.src_root = root.resolve()
+        if out_dir is not None:
+            # Mirror the whitelisted tree into out_dir; untouched files are copied as-is
+            self.out_dir = out_dir.resolve()
+            copied = sum(_copy_if_changed(p, self._dest_for(p)) for p in others)
+            print(f" Mirrored {len(others)} other file(s) into {self.out_dir} ({copied} updated)")
+        if jobs > 1 and len(files) > 1:
+            return self._process_parallel(files, write=write, max_bytes=max_bytes, jobs=jobs)
+        processed = 0
+        for p in files:
+            if self.process_file(p, write=write, max_bytes=max_bytes):
+                processed += 1
+        return processed
+
+    def _process_parallel(self, files: List[Path], *, write: bool, max_bytes: int, jobs: int) -> int:
+        """
+        Largest files are submitted first so one big file does not finish the run alone;
+        logs are printed in path order as soon as every earlier file is done, so the
+        output matches a sequential run however the work was scheduled.
+        """
+        def size(p: Path) -> int:
+            try:
+                return p.stat().st_size
+            except OSError:
+                return 0
+        order = sorted(range(len(files)), key=lambda i: (-size(files[i]), i))
+        results = [None] * len(files)
+        next_out = processed = 0
+        with ProcessPoolExecutor(max_workers=jobs, initializer=_worker_init, initargs=(self, DEBUG)) as pool:
+            futures = {pool.submit(_worker_run, files[i], write, max_bytes): i for i in order}
+            for fut in as_completed(futures):
+                results[futures[fut]] = fut.result()
+                while next_out < len(files) and results[next_out] is not None:
+                    changed, delta, log, patch = results[next_out]
+                    sys.stdout.write(log)
+                    if patch:
+                        self.diff.append(patch)
+                    for k, v in delta.items():
+                        self.stats[k] += v
+                    processed += changed
+                    results[next_out] = ()
+                    next_out += 1
         return processed
 
+    def watch(self, root: Path, *, interval: float, listen: Optional[int], max_bytes: int, jobs: int,
+              compile_db: Path = None, **selector):
+        """
+        --watch: stay resident after the first pass and regenerate only the outputs whose
+        source (mtime, size) changed since the last scan; the first scan compares with the
+        state before process_tree, so edits made during the first pass count. Outputs of
+        removed files are deleted. With --compile-commands the selection is redone only when the database or
+        a selected file changed. With listen, a 'sync' line on 127.0.0.1:listen triggers a
+        scan right away and is answered with 'done <n>' once the outputs are up to date.
+        """
+        scan = _stat_snapshot
+
+        def selection() -> Tuple[List[Path], Set[Path]]:
+            with redirect_stdout(io.StringIO()):
+                files, others = self.select_files(root, compile_db=compile_db, out_dir=self.out_dir, **selector)
+            return files + others, set(others)
+
+        def db_state():
+            return scan([compile_db]) if compile_db is not None else {}
+
+        if self.first_pass is not None:
+            paths, others, state, db = self.first_pass
+        else:
+            paths, others = selection()
+            state, db = scan(paths), db_state()
+
+        def sync() -> int:
+            nonlocal paths, others, state, db
+            if compile_db is None or db_state() != db:
+                paths, others = selection()
+                db = db_state()
+            now = scan(paths)
+            changed = [p for p, st in now.items() if state.get(p) != st]
+            if compile_db is not None and changed:
+                paths, others = selection()             # includes may have changed
+                now = scan(paths)
+                changed = [p for p, st in now.items() if state.get(p) != st]
+            removed = [p for p in state if p not in now]
+            state = now
+            for p in removed:
+                dest = self._dest_for(p)
+                if dest is not None and dest.is_file():
+                    dest.unlink()
+                    print(f" Removed: {dest}")
+            sources = [p for p in changed if p not in others]
+            for p in changed:
+                if p in others:
+                    _copy_if_changed(p, self._dest_for(p))
+            if jobs > 1 and len(sources) > 1:
+                self._process_parallel(sources, write=False, max_bytes=max_bytes, jobs=jobs)
+            else:
+                for p in sources:
+                    self.process_file(p, max_bytes=max_bytes)
+            if changed or removed:
+                print(f" Updated {len(changed)} file(s), removed {len(removed)}")
+            sys.stdout.flush()
+            return len(changed) + len(removed)
+
+        srv = None
+        if listen is not None:
+            srv = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+            srv.bind(('127.0.0.1', listen))
+            srv.listen(8)
+        print(f" Watching {len(paths)} file(s) every {interval:g}s"
+              + (f", sync requests on 127.0.0.1:{listen}" if srv else "") + " (Ctrl+C to stop)")
+        sys.stdout.flush()
+        try:
+            while True:
+                if srv is None:
+                    time.sleep(interval)
+                    sync()
+                    continue
+                ready, _, _ = select.select([srv], [], [], interval)
+                if not ready:
+                    sync()
+                    continue
+                conn, _ = srv.accept()
+                with conn:
+                    conn.settimeout(5)
+                    try:
+                        req = conn.makefile('r').readline().strip()
+                        conn.sendall(f"done {sync()}\n".encode() if req == 'sync' else b"error unknown request\n")
+                    except OSError:
+                        pass
+        except KeyboardInterrupt:
+            print("\n Watch stopped")
+        finally:
+            if srv is not None:
+                srv.close()
+
     def print_stats(self):
         print("\nStats:")
         for k, v in self.stats.items():
             print(f"  {k}: {v}")
 
+# ---------------- worker processes (--jobs) ----------------
+_WORKER = None
+
+def _worker_init(obf: 'SafeCppObfuscator', debug: bool):
+    global _WORKER, DEBUG
+    _WORKER, DEBUG = obf, debug
+    random.seed()    # forked workers would otherwise share the parent's junk sequence
+
+def _worker_run(path: Path, write: bool, max_bytes: int):
+    before = dict(_WORKER.stats)
+    buf = io.StringIO()
+    with redirect_stdout(buf):
+        changed = _WORKER.process_file(path, write=write, max_bytes=max_bytes)
+    delta = {k: v - before[k] for k, v in _WORKER.stats.items()}
+    patch = ''
+    if _WORKER.diff:
+        patch = ''.join(_WORKER.diff)
+        _WORKER.diff.clear()
+    return changed, delta, buf.getvalue(), patch
+
+# ---------------- output helpers ----------------
+def _line_opcodes(a: List[str], b: List[str], window: int = 32):
+    """
+    difflib-style opcodes from one forward walk. The stages insert lines and edit lines in
+    place, so a short lookahead resynchronises; SequenceMatcher goes quadratic on large,
+    repetitive sources. The result is always a valid edit script, if not a minimal one.
+    """
+    ops = []
+    def add(tag, i1, i2, j1, j2):
+        if ops and ops[-1][0] == tag and tag == 'equal':
+            ops[-1] = (tag, ops[-1][1], i2, ops[-1][3], j2)
+        else:
+            ops.append((tag, i1, i2, j1, j2))
+    i = j = 0
+    n, m = len(a), len(b)
+    while i < n and j < m:
+        if a[i] == b[j]:
+            add('equal', i, i + 1, j, j + 1); i += 1; j += 1
+            continue
+        k = next((k for k in range(j + 1, min(m, j + window)) if b[k] == a[i]), -1)
+        if k != -1:
+            add('insert', i, i, j, k); j = k
+            continue
+        k = next((k for k in range(i + 1, min(n, i + window)) if a[k] == b[j]), -1)
+        if k != -1:
+            add('delete', i, k, j, j); i = k
+            continue
+        add('replace', i, i + 1, j, j + 1); i += 1; j += 1
+    if i < n or j < m:
+        add('replace', i, n, j, m)
+    return ops
+
+def _grouped_opcodes(ops, n: int = 3):
+    # hunks with n lines of context, as difflib.SequenceMatcher.get_grouped_opcodes
+    if not ops:
+        return
+    codes = list(ops)
+    if codes[0][0] == 'equal':
+        tag, i1, i2, j1, j2 = codes[0]
+        codes[0] = tag, max(i1, i2 - n), i2, max(j1, j2 - n), j2
+    if codes[-1][0] == 'equal':
+        tag, i1, i2, j1, j2 = codes[-1]
+        codes[-1] = tag, i1, min(i2, i1 + n), j1, min(j2, j1 + n)
+    group = []
+    for tag, i1, i2, j1, j2 in codes:
+        if tag == 'equal' and i2 - i1 > 2 * n:
+            group.append((tag, i1, min(i2, i1 + n), j1, min(j2, j1 + n)))
+            yield group
+            group = []
+            i1, j1 = max(i1, i2 - n), max(j1, j2 - n)
+        group.append((tag, i1, i2, j1, j2))
+    if group and not (len(group) == 1 and group[0][0] == 'equal'):
+        yield group
+
+def _unified_diff(rel: str, old: str, new: str) -> str:
+    # git-style a/ b/ headers; lines split on '\n' only, so '\r' and form feeds stay in place
+    def lines(s: str) -> List[str]:
+        return re.findall(r'[^\n]*\n|[^\n]+$', s)
+    def span(lo: int, hi: int) -> str:
+        if hi - lo == 1:
+            return f'{lo + 1}'
+        return f'{lo if hi == lo else lo + 1},{hi - lo}'
+    def emit(prefix: str, line: str):
+        out.append(prefix + line)
+        if not line.endswith('\n'):
+            out.append('\n\\ No newline at end of file\n')
+    a, b = lines(old), lines(new)
+    out = [f'--- a/{rel}\n', f'+++ b/{rel}\n']
+    for group in _grouped_opcodes(_line_opcodes(a, b)):
+        out.append(f'@@ -{span(group[0][1], group[-1][2])} +{span(group[0][3], group[-1][4])} @@\n')
+        for tag, i1, i2, j1, j2 in group:
+            if tag == 'equal':
+                for line in a[i1:i2]:
+                    emit(' ', line)
+                continue
+            for line in a[i1:i2]:
+                emit('-', line)
+            for line in b[j1:j2]:
+                emit('+', line)
+    return ''.join(out) if len(out) > 2 else ''
+
+def _copy_if_changed(src: Path, dst: Path) -> bool:
+    data = src.read_bytes()
+    try:
+        if dst.read_bytes() == data:
+            return False
+    except OSError:
+        pass
+    dst.parent.mkdir(parents=True, exist_ok=True)
+    dst.write_bytes(data)
+    return True
+
+def _write_if_changed(path: Path, text: str) -> bool:
+    try:
+        if path.read_text(encoding='utf-8') == text:
+            return False
+    except Exception:
+        pass
+    path.parent.mkdir(parents=True, exist_ok=True)
+    path.write_text(text, encoding='utf-8')
+    return True
+
+# ---------------- pre-generated junk pool ----------------
+def emit_junk_pool(out_dir: Path, pool_size: int, shards: int) -> int:
+    """
+    Write the junk pool TUs for JUNK_PREGENERATED builds: junk_pool_<k>.cpp, each holding
+    the explicit instantiations of a contiguous range of pool slots. Unchanged shards are
+    left untouched so the build system does not recompile them.
+    """
+    shards = max(1, min(shards, pool_size))
+    per = (pool_size + shards - 1) // shards
+    written = 0
+    for k in range(shards):
+        lo, hi = k * per, min(pool_size, (k + 1) * per)
+        lines = [
+            "// Generated by obfuscate.py --emit-junk-pool -- do not edit.",
+            f"// Junk pool slots [{lo}, {hi}) of {pool_size}.",
+            "#define JUNK_POOL_IMPL 1",
+            "#include <Junk.h>",
+            "",
+            f'static_assert(JUNK_POOL_SIZE == {pool_size}, "junk pool generated for a different JUNK_POOL_SIZE");',
+            "",
+        ]
+        lines += [f"JUNK_POOL_ENTRY({i})" for i in range(lo, hi)]
+        if _write_if_changed(out_dir / f"junk_pool_{k}.cpp", '\n'.join(lines) + '\n'):
+            written += 1
+    print(f"Junk pool: {pool_size} slots in {shards} file(s) under {out_dir} ({written} updated)")
+    return written
+
+# ---------------- --sync client ----------------
+def sync_with_watcher(port: int, timeout: float = 600.0) -> bool:
+    # Ask a --watch --listen process to bring its outputs up to date; False if none is listening
+    try:
+        with socket.create_connection(('127.0.0.1', port), timeout=2) as conn:
+            conn.settimeout(timeout)
+            conn.sendall(b"sync\n")
+            reply = conn.makefile('r').readline().strip()
+    except OSError:
+        return False
+    if not reply.startswith('done'):
+        return False
+    print(f" Watcher on port {port}: {reply}")
+    return True
+
 # ---------------- CLI ----------------
 def main():
     global DEBUG
-    ap = argparse.ArgumentParser(description="Safe C++ obfuscator (iostream/printf/MessageBox; dry-run by default)")
-    ap.add_argument('path', help='Project root to scan')
-    ap.add_argument('--write', action='store_true', help='Apply changes (default: dry-run)')
-    ap.add_argument('--max-bytes', type=int, default=524288, help='Skip files larger than this')
+    ap = argparse.ArgumentParser(description="Safe C++ obfuscator (iostream/printf/MessageBox/logging sinks; dry-run by default)")
+    ap.add_argument('path', nargs='?', help='Project root to scan')
+    ap.add_argument('--write', action='store_true', help='Apply changes in place (default: dry-run)')
+    ap.add_argument('--out-dir', metavar='DIR',
+                    help='Write the transformed tree to DIR instead of in place; only changed outputs are rewritten')
+    ap.add_argument('--max-bytes', type=int, default=0, help='Skip files larger than this (0 = no limit)')
+    ap.add_argument('--stream-bytes', type=int, default=1 << 20,
+                    help='Transform files larger than this in chunks over a memory map')
     ap.add_argument('--whitelist', nargs='*', default=['src','Include'],
                     help='Top-level dirs to process under root')
     ap.add_argument('--exclude', nargs='*', default=['src/hmac','src/SHA'],
                     help='Subpath substrings to exclude')
+    ap.add_argument('--compile-commands', metavar='JSON',
+                    help='Process exactly the TUs in this compile_commands.json and the headers they '
+                         'include (under the project root); replaces --whitelist')
+    ap.add_argument('--target', help='With --compile-commands: only TUs of this CMake target')
+    ap.add_argument('--profile', metavar='FILE',
+                    help='Sampling profile (`perf script` output or folded stacks) for hot-function handling')
+    ap.add_argument('--hot-threshold', type=float, default=1.0,
+                    help='Self-sample share (percent) from which a function counts as hot')
+    ap.add_argument('--hot-action', choices=('light', 'skip'), default='light',
+                    help='Hot functions get only JUNK_INLINE_BYTES() (light) or no junk at all (skip)')
     ap.add_argument('--debug', action='store_true', help='Print which strings are being wrapped')
+    ap.add_argument('--jobs', '-j', type=int, default=1,
+                    help='Worker processes (0 = one per CPU)')
+    ap.add_argument('--cache-dir', metavar='DIR',
+                    help='Reuse transform results for unchanged files from DIR')
+    ap.add_argument('--seed', help='Derive every junk choice from this seed and the site (path + function), '
+                                   'so the same seed gives byte-identical output')
+    ap.add_argument('--sinks-config', metavar='JSON',
+                    help='Add, change or (null) remove string sinks: {"name": {"wrap": "prefix|cstr|view", '
+                         '"format": "runtime|vformat|keep", "fmt_arg": n}}')
+    ap.add_argument('--string-table', action='store_true',
+                    help='Encrypt wrapped narrow literals here and reference them from one table per TU '
+                         '(OBS_TBL*) instead of encrypting each one in constexpr')
+    ap.add_argument('--strip', action='store_true',
+                    help='Only remove what earlier runs injected (everything between /*obf+*/ markers)')
+    ap.add_argument('--max-header-tokens', type=int, default=256,
+                    help='Skip function/lambda headers longer than this many tokens')
+    ap.add_argument('--diff', metavar='FILE',
+                    help="Write no sources; emit one unified diff of all changes to FILE ('-' = stdout), "
+                         "paths relative to the project root")
+    ap.add_argument('--watch', action='store_true',
+                    help='After the first pass keep running and regenerate changed files (needs --out-dir)')
+    ap.add_argument('--poll-interval', type=float, default=0.5, help='Seconds between --watch scans')
+    ap.add_argument('--listen', type=int, metavar='PORT',
+                    help='With --watch: answer --sync requests on 127.0.0.1:PORT')
+    ap.add_argument('--sync', type=int, metavar='PORT',
+                    help='Let a --watch --listen process on PORT update the outputs; '
+                         'falls back to a normal run when none is listening')
+    ap.add_argument('--emit-junk-pool', metavar='DIR',
+                    help='Write junk_pool_<k>.cpp for JUNK_PREGENERATED builds into DIR')
+    ap.add_argument('--junk-pool-size', type=int, default=256, help='Pool slots (must match JUNK_POOL_SIZE)')
+    ap.add_argument('--junk-pool-shards', type=int, default=4, help='Number of junk pool TUs to spread the slots over')
     args = ap.parse_args()
 
     DEBUG = bool(args.debug)
 
+    if args.emit_junk_pool:
+        emit_junk_pool(Path(args.emit_junk_pool), args.junk_pool_size, args.junk_pool_shards)
+        if not args.path:
+            return
+    if not args.path:
+        ap.error('path is required unless --emit-junk-pool is given')
+
     root = Path(args.path)
     if not root.exists():
         print(f"Path not found: {root}")
         sys.exit(1)
+    if args.watch and not args.out_dir:
+        ap.error('--watch needs --out-dir')
+    if args.diff and (args.write or args.out_dir or args.watch):
+        ap.error('--diff cannot be combined with --write, --out-dir or --watch')
+    if args.sync is not None and sync_with_watcher(args.sync):
+        return
 
-    obf = SafeCppObfuscator()
-    count = obf.process_tree(root, write=args.write, max_bytes=args.max_bytes,
-                             whitelist=set(args.whitelist), excludes=set(args.exclude))
-    print(f"\nProcessed files: {count}")
-    obf.print_stats()
+    obf = SafeCppObfuscator(max_header_tokens=args.max_header_tokens)
+    obf.stream_bytes = args.stream_bytes
+    obf.seed = args.seed
+    obf.string_table = args.string_table
+    obf.strip = args.strip
+    if args.sinks_config:
+        try:
+            obf.sinks = load_sinks(Path(args.sinks_config))
+        except (OSError, ValueError) as e:
+            ap.error(f'--sinks-config: {e}')
+    if args.profile:
+        obf.profile = HotProfile(Path(args.profile))
+        obf.hot_threshold, obf.hot_action = args.hot_threshold, args.hot_action
+    if args.cache_dir:
+        obf.cache = ResultCache(Path(args.cache_dir), obf.cache_options())
+    jobs = args.jobs or os.cpu_count() or 1
+    selector = dict(whitelist=set(args.whitelist), excludes=set(args.exclude),
+                    compile_db=Path(args.compile_commands) if args.compile_commands else None,
+                    target=args.target)
+    if args.diff:
+        obf.diff = []
+    # with the diff on stdout, the log goes to stderr
+    with redirect_stdout(sys.stderr) if args.diff == '-' else nullcontext():
+        count = obf.process_tree(root, write=args.write, max_bytes=args.max_bytes, jobs=jobs,
+                                 out_dir=Path(args.out_dir) if args.out_dir else None, **selector)
+        print(f"\nProcessed files: {count}")
+        obf.print_stats()
+    if args.diff == '-':
+        sys.stdout.write(''.join(obf.diff))
+    elif args.diff:
+        with open(args.diff, 'w', encoding='utf-8', newline='') as f:
+            f.write(''.join(obf.diff))
+        print(f"Diff for {len(obf.diff)} file(s) written to {args.diff}")
+    if args.watch:
+        obf.watch(root, interval=args.poll_interval, listen=args.listen,
+                  max_bytes=args.max_bytes, jobs=jobs, **selector)
 
 if __name__ == '__main__':
     main()
@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+pathological.py - Run obfuscate.py over the pathological-input corpus under a timeout.
+
+The inputs stress the tokenizer and stage_function_bodies. The small hand-written cases
+(unterminated string/char literals, a splice at end of file) live in
+corpus/pathological/{src,Include}; the large, repetitive ones (long identifier runs,
+deep brace/paren nesting, a macro-heavy header, an unterminated raw literal and comment
+followed by many lines) are generated into a temp dir by this script. Each file is
+processed on its own, so a hang is attributed to one input, and must
+  - finish within --timeout seconds per pass and exit with status 0,
+  - give the same output when the output is processed again (idempotent re-run),
+  - come back byte-identical to the input after --strip.
+Exits with status 1 if any file fails.
+
+Usage:
+  python pathological.py
+  python pathological.py --timeout 10 --corpus my_inputs --no-generated
+"""
+
+import argparse
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+from pathlib import Path
+
+HERE = Path(__file__).resolve().parent
+OBFUSCATE = HERE / "obfuscate.py"
+CORPUS = HERE / "corpus" / "pathological"
+
+
+def long_identifiers() -> str:
+    # a function-header candidate that never ends, one huge identifier, a long qualifier run
+    words = " ".join("unsigned" if i % 7 == 0 else f"id{i}_" + "x" * (i % 40) for i in range(3000))
+    return ("// Long identifier runs: a function-header candidate that never ends, and one huge identifier.\n"
+            "#include <cstdio>\n\n#define NOTHING\n"
+            f"{words}\n;\n\n"
+            f"static int {'a' * 32768} = 1;\n\n"
+            "int run_of_qualifiers() {\n"
+            f"    return {'ns::' * 4000}value + {'a' * 32768};\n}}\n\n"
+            "int main() {\n    std::printf(\"%d\\n\", run_of_qualifiers());\n    return 0;\n}\n")
+
+
+def deep_nesting() -> str:
+    return ("// Deep brace and paren nesting.\n#include <cstdio>\n\n"
+            f"int deep_braces(int x) {{\n{'{' * 3000}\n    x += 1;\n{'}' * 3000}\n    return x;\n}}\n\n"
+            f"int deep_parens(int x) {{\n    return {'(' * 3000}x{')' * 3000};\n}}\n\n"
+            f"int deep_lambdas() {{\n    return {'[]{ return ' * 300}1;{' }();' * 300}\n}}\n\n"
+            f"int unbalanced_tail(int x) {{\n    if (x) {{ {'(' * 500} }}\n    {')' * 700}\n    {'}' * 50}\n"
+            "    return x;\n}\n\n"
+            "int main() {\n    std::printf(\"%d\\n\", deep_braces(deep_parens(1)));\n    return 0;\n}\n")
+
+
+def macro_heavy() -> str:
+    defines = "".join(f"#define M{i}(x) CAT(x, {i}) + M{max(i - 1, 0)}(x)\n" for i in range(400))
+    fns = "".join(f"FN(gen_{i})\n" for i in range(200))
+    cont = "".join(f"    x{i} + \\\n" for i in range(2000))
+    return ("// Macro-heavy header: bodies hidden in macros, braces in directives, continuation lines.\n"
+            "#pragma once\n#include <cstdio>\n\n"
+            "#define BEGIN {\n#define END }\n"
+            "#define FN(name) void name() BEGIN std::printf(#name \"\\n\"); END\n"
+            "#define CALL(f, ...) f(__VA_ARGS__)\n#define STR(x) #x\n#define CAT(a, b) a##b\n"
+            "#define MULTI_LINE(a) \\\n    do { \\\n        std::printf(\"%d\\n\", (a)); \\\n    } while (0)\n\n"
+            f"{defines}{fns}\n"
+            "#if 0\nint inside_if0( { \"unterminated in if0\n#endif\n\n"
+            "inline int uses_macros(int v) BEGIN\n    MULTI_LINE(v);\n"
+            "    return CALL(STR, v)[0] == 'v' ? 1 : 0;\nEND\n\n"
+            "#define OPEN_FN int opened() {\nOPEN_FN return 2; }\n\n"
+            f"#define LONG_MACRO \\\n{cont}    0\n\n")
+
+
+def unterminated_raw() -> str:
+    return ("// Raw string literal whose delimiter never appears again.\n#include <cstdio>\n\n"
+            "void f() {\n    std::printf(\"before\\n\");\n"
+            "    const char* r = R\"delim(\n        { ( [ \"not a string end )delim-not\n    \";\n}\n"
+            + "".join(f"void g{i}() {{ std::printf(\"g{i}\\n\"); }}\n" for i in range(200)))
+
+
+def unterminated_comment() -> str:
+    return ("// Block comment running to end of file.\n#include <cstdio>\n\n"
+            "void f() {\n    std::printf(\"before\\n\");\n}\n\n"
+            "/* never closed\nvoid g() { std::printf(\"inside comment\\n\"); }\n"
+            + "int x = 1; { ( \"\n" * 2000)
+
+
+GENERATED = {
+    "src/long_identifiers.cpp": long_identifiers,
+    "src/deep_nesting.cpp": deep_nesting,
+    "src/unterminated_raw.cpp": unterminated_raw,
+    "src/unterminated_comment.cpp": unterminated_comment,
+    "Include/macro_heavy.h": macro_heavy,
+}
+
+
+def obfuscate(root: Path, out: Path, timeout: float, *extra: str) -> float:
+    cmd = [sys.executable, str(OBFUSCATE), str(root), "--out-dir", str(out),
+           "--whitelist", "src", "Include", "--jobs", "1", *extra]
+    t0 = time.perf_counter()
+    res = subprocess.run(cmd, capture_output=True, text=True, timeout=timeout)
+    if res.returncode != 0 or "Traceback" in res.stderr:
+        raise RuntimeError(f"exit {res.returncode}\n{res.stderr.strip()}")
+    return time.perf_counter() - t0
+
+
+def check(path: Path, rel: Path, work: Path, timeout: float) -> str:
+    """Returns '' on success, else the reason."""
+    root = work / "in"
+    (root / rel).parent.mkdir(parents=True)
+    shutil.copyfile(path, root / rel)
+    try:
+        secs = obfuscate(root, work / "out1", timeout, "--seed", "1")
+        out1 = work / "out1" / rel
+        secs += obfuscate(work / "out1", work / "out2", timeout, "--seed", "1")
+        secs += obfuscate(work / "out1", work / "out3", timeout, "--strip")
+    except subprocess.TimeoutExpired:
+        return f"timed out after {timeout:g} s"
+    except RuntimeError as e:
+        return str(e)
+
+    again = work / "out2" / rel
+    if again.exists() and again.read_bytes() != out1.read_bytes():
+        return "not idempotent: a second run changed the output"
+    stripped = work / "out3" / rel
+    if (stripped.read_bytes() if stripped.exists() else out1.read_bytes()) != path.read_bytes():
+        return "--strip did not restore the input"
+    print(f"  ok    {rel}  ({secs:.2f} s)")
+    return ""
+
+
+def main():
+    ap = argparse.ArgumentParser(description="obfuscate.py over pathological inputs, under a timeout.")
+    ap.add_argument("--corpus", default=str(CORPUS), help="Corpus root with src/ and Include/.")
+    ap.add_argument("--timeout", type=float, default=30.0, help="Seconds allowed per obfuscate.py pass.")
+    ap.add_argument("--no-generated", action="store_true", help="Only run the inputs under --corpus.")
+    args = ap.parse_args()
+
+    corpus = Path(args.corpus)
+    gen = Path(tempfile.mkdtemp(prefix="pathological-gen-"))
+    try:
+        files = [(p, p.relative_to(corpus)) for d in ("src", "Include")
+                 for p in sorted((corpus / d).rglob("*")) if p.is_file()]
+        if not args.no_generated:
+            for rel, make in GENERATED.items():
+                path = gen / rel
+                path.parent.mkdir(parents=True, exist_ok=True)
+                path.write_text(make(), encoding="utf-8", newline="\n")
+                files.append((path, Path(rel)))
+        if not files:
+            print(f"No inputs under {corpus}/src or {corpus}/Include")
+            sys.exit(1)
+
+        failed = 0
+        for path, rel in sorted(files, key=lambda f: str(f[1])):
+            work = Path(tempfile.mkdtemp(prefix="pathological-"))
+            try:
+                why = check(path, rel, work, args.timeout)
+            finally:
+                shutil.rmtree(work, ignore_errors=True)
+            if why:
+                failed += 1
+                print(f"  FAIL  {rel}: {why}")
+    finally:
+        shutil.rmtree(gen, ignore_errors=True)
+    print(f"\n{len(files) - failed}/{len(files)} passed")
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
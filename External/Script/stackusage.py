@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+stackusage.py - Report per-site junk stack cost from GCC/Clang -fstack-usage output.
+
+Each junk site is a chain of frames:
+  emit<Line,Ctr>                   -> emit_core -> p_* pattern -> keep<T>
+  emit_heavy<Line,Ctr>             -> emit<Line,Ctr> chain | emit_core chain
+  emit_branchless<Line,Ctr>        -> bl_* / p_* block -> keep<T>
+  emit_branchless_heavy<Line,Ctr>  -> emit_branchless<Line,Ctr> chain | block chain
+The report sums the measured frames along the deepest chain of every site.
+
+Usage:
+  python stackusage.py out/build/Obfuscator/CMakeFiles/Obfuscator.dir
+  python stackusage.py build_dir --budget 256 --strict
+"""
+
+import argparse
+import re
+import sys
+from pathlib import Path
+from typing import Dict, Iterable, Tuple
+
+# GCC: "void junk_detail::emit() [with int Line = 12; int Ctr = 3]"
+# Clang: "void junk_detail::emit<12, 3>()"
+# Matches every emit* entry point (emit, emit_heavy, emit_branchless, emit_branchless_heavy).
+_SITE_GCC   = re.compile(r'junk_detail::(emit\w*)\(\) \[with int Line = (\d+); int Ctr = (\d+)\]')
+_SITE_CLANG = re.compile(r'junk_detail::(emit\w*)<(\d+),\s*(\d+)>')
+# GCC cuts names at the last '.', so "[with ...; long unsigned int ...I = {0, 1}]" loses
+# the function; the name is then read back from the declaration at file:line.
+_DECL_NAME  = re.compile(r'\b(emit\w*|bl_\w+|p_\w+|keep)\s*\(')
+_decl_lines: Dict[str, list] = {}
+
+
+def resolve_name(src: str, line: int, name: str) -> str:
+    if "junk_detail::" in name or not src.endswith("Junk.h"):
+        return name
+    if src not in _decl_lines:
+        try:
+            _decl_lines[src] = Path(src).read_text(encoding="utf-8", errors="replace").splitlines()
+        except OSError:
+            _decl_lines[src] = []
+    lines = _decl_lines[src]
+    m = _DECL_NAME.search(lines[line - 1]) if 0 < line <= len(lines) else None
+    return f"junk_detail::{m.group(1)}({name}" if m else name
+
+
+def iter_su_files(inputs: Iterable[str]) -> Iterable[Path]:
+    for raw in inputs:
+        p = Path(raw)
+        if p.is_dir():
+            yield from p.rglob("*.su")
+        elif p.is_file():
+            yield p
+
+
+def parse_su(path: Path) -> Iterable[Tuple[str, int]]:
+    # Line format: "<file>:<line>:<col>:<function>\t<bytes>\t<qualifiers>"
+    for line in path.read_text(encoding="utf-8", errors="replace").splitlines():
+        parts = line.split("\t")
+        if len(parts) < 2:
+            continue
+        loc = parts[0].split(":", 3)
+        name = loc[3] if len(loc) == 4 else parts[0]
+        if len(loc) == 4 and loc[1].isdigit():
+            name = resolve_name(loc[0], int(loc[1]), name)
+        try:
+            yield name, int(parts[1])
+        except ValueError:
+            continue
+
+
+def collect(paths: Iterable[Path]):
+    patterns: Dict[str, int] = {}
+    sites: Dict[Tuple[str, str, int, int], int] = {}
+    core = keep = 0
+    for su in paths:
+        tu = su.name[:-3]
+        for name, size in parse_su(su):
+            if "junk_detail::" not in name:
+                continue
+            m = _SITE_GCC.search(name) or _SITE_CLANG.search(name)
+            if m:
+                key = (tu, m.group(1), int(m.group(2)), int(m.group(3)))
+                sites[key] = max(sites.get(key, 0), size)
+            elif "junk_detail::emit_core" in name:
+                core = max(core, size)
+            elif "junk_detail::keep" in name:
+                keep = max(keep, size)
+            elif "junk_detail::p_" in name or "junk_detail::bl_" in name:
+                short = re.split(r"[(<]", name.split("junk_detail::", 1)[1], 1)[0]
+                patterns[short] = max(patterns.get(short, 0), size)
+    return patterns, sites, core, keep
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Per-site junk stack cost from -fstack-usage (.su) files.")
+    ap.add_argument("inputs", nargs="+", help=".su files or build directories (recursively scanned).")
+    ap.add_argument("--budget", type=int, default=0, help="Flag sites whose chain exceeds this many bytes.")
+    ap.add_argument("--strict", action="store_true", help="Exit with status 1 if any site is over budget.")
+    ap.add_argument("--top", type=int, default=0, help="Only print the N most expensive sites.")
+    args = ap.parse_args()
+
+    patterns, sites, core, keep = collect(iter_su_files(args.inputs))
+    if not patterns and not sites:
+        print("No junk frames found. Build with -fstack-usage (OBFUSCATOR_STACK_USAGE=ON).")
+        return
+
+    worst_pattern = max(patterns.values(), default=0)
+    tails = {"emit": core + worst_pattern + keep,   # emit -> emit_core -> pattern
+             "emit_branchless": worst_pattern + keep}  # block called straight from the site
+
+    rows = []
+    for (tu, kind, line, ctr), own in sites.items():
+        base = kind[:-len("_heavy")] if kind.endswith("_heavy") else kind
+        tail = tails.get(base, tails["emit"])
+        if kind == base:
+            total = own + tail
+        else:
+            inner = sites.get((tu, base, line, ctr), 0)
+            total = own + max(inner + tail, tail)
+        rows.append((total, own, tu, kind, line, ctr))
+    rows.sort(key=lambda r: (-r[0], r[2], r[4], r[5]))
+
+    print("Patterns:")
+    for name, size in sorted(patterns.items(), key=lambda kv: -kv[1]):
+        print(f"  {name:<20} {size:>6} bytes")
+    print(f"  {'emit_core':<20} {core:>6} bytes")
+    print(f"  {'keep<T>':<20} {keep:>6} bytes")
+
+    over = sum(1 for r in rows if args.budget and r[0] > args.budget)
+    print("\nSites (deepest chain):")
+    for total, own, tu, kind, line, ctr in (rows[:args.top] if args.top else rows):
+        flag = "  OVER BUDGET" if args.budget and total > args.budget else ""
+        print(f"  {tu}:{line} {kind}<{line},{ctr}>  frame={own}  chain={total}{flag}")
+
+    if rows:
+        print(f"\nSites: {len(rows)}  max chain: {rows[0][0]} bytes")
+    if args.budget:
+        print(f"Over budget ({args.budget} bytes): {over}")
+        if over and args.strict:
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -1,13 +1,21 @@
 ﻿// Junk.h — highly-varied junk emitter (MSVC/Clang/GCC)
 // - Each call site produces a different code *shape* and a *different amount* of junk.
-// - Per-build variation via __TIME__/__DATE__/__FILE__ (already mixed in).
+// - Per-build variation via __TIME__/__DATE__/__FILE__ (already mixed in), or a fixed JUNK_BUILD_SEED.
 // - Includes a size-jitter pad so the final DLL/EXE size varies each build.
 // - Works in Release; resists dead-code elimination with volatile + noinline.
+// - Optional per-site stack budget (JUNK_STACK_BUDGET) and frame-free mode (JUNK_FRAME_FREE).
+// - Optional branch-free mode (JUNK_BRANCHLESS): straight-line blocks, no loops or ifs.
+// - JUNK_INLINE_BYTES(): never-executed opcode bytes jumped over in the caller (GCC/Clang x86/x64).
+// - Optional adaptive mode (JUNK_ADAPTIVE): sites back off while called faster than a threshold.
+// - Optional runtime on/off switch (JUNK_RUNTIME_SWITCH): set_enabled(bool) patches the sites of a module.
+// - Optional pre-generated pool (JUNK_PREGENERATED): emitters compiled once in generated TUs.
+// - Junk symbols are internal or hidden: nothing lands in .dynsym or needs COMDAT folding.
 
 #pragma once
 #include <cstdint>
 #include <cstddef>
 #include <type_traits>
+#include <utility>
 
 // -------- Attributes --------
 #if defined(_MSC_VER)
@@ -16,9 +24,149 @@
 #define JNK_NOINLINE __attribute__((noinline))
 #endif
 
-// Disable optimizations for the pattern functions (MSVC needs file-scope pragma)
 #if defined(_MSC_VER)
-#pragma optimize("", off)
+#define JNK_FORCEINLINE __forceinline
+#else
+#define JNK_FORCEINLINE inline __attribute__((always_inline))
+#endif
+
+// -------- Stack budget --------
+// JUNK_STACK_BUDGET: max estimated bytes of stack a single site may use (0 = unlimited).
+//   Patterns that would exceed it are swapped for the frame-free p_reg_mix.
+// JUNK_FRAME_FREE: every site uses p_reg_mix only and the emitters are inlined into
+//   the caller, so a site costs one return address on top of the caller's frame.
+#ifndef JUNK_STACK_BUDGET
+#define JUNK_STACK_BUDGET 0
+#endif
+#ifndef JUNK_FRAME_FREE
+#define JUNK_FRAME_FREE 0
+#endif
+
+// JUNK_BRANCHLESS: sites expand to emit_branchless/emit_branchless_heavy, built from
+//   fully unrolled straight-line blocks whose counts and pattern choice are compile-time.
+//   Keeps BTB / pattern-history entries free for real code.
+#ifndef JUNK_BRANCHLESS
+#define JUNK_BRANCHLESS 0
+#endif
+
+// JUNK_ADAPTIVE: each site counts its calls in thread-local state and checks a coarse
+//   clock once per JUNK_ADAPTIVE_WINDOW calls. While the rate is above
+//   JUNK_ADAPTIVE_MAX_CPS calls/second the site only bumps its counter; it re-enables
+//   itself at the first window that comes in under the threshold.
+#ifndef JUNK_ADAPTIVE
+#define JUNK_ADAPTIVE 0
+#endif
+#ifndef JUNK_ADAPTIVE_MAX_CPS
+#define JUNK_ADAPTIVE_MAX_CPS 100000
+#endif
+#ifndef JUNK_ADAPTIVE_WINDOW // ~15 ms of traffic at the threshold
+#define JUNK_ADAPTIVE_WINDOW ((JUNK_ADAPTIVE_MAX_CPS / 64) < 16 ? 16 : (JUNK_ADAPTIVE_MAX_CPS / 64) > 65535 ? 65535 : (JUNK_ADAPTIVE_MAX_CPS / 64))
+#endif
+
+#ifndef JUNK_ADAPTIVE_TLS_MODEL // tls_model of the per-site state in shared objects, see tl_rate
+#define JUNK_ADAPTIVE_TLS_MODEL "local-dynamic"
+#endif
+
+#if JUNK_ADAPTIVE
+#include <chrono>
+#endif
+
+// JUNK_RUNTIME_SWITCH (default 0): every site is gated by junk_detail::set_enabled(bool).
+//   On GCC/Clang x86/x64 ELF the gate is a patchable 5-byte instruction (static key):
+//   enabled it is a jmp into the junk, disabled a flags-only cmp. Elsewhere it is a relaxed
+//   atomic load. Off by default so plain builds don't pull <atomic>/<mutex>/<sys/mman.h>
+//   into every TU that includes this header.
+#ifndef JUNK_RUNTIME_SWITCH
+#define JUNK_RUNTIME_SWITCH 0
+#endif
+
+#if JUNK_RUNTIME_SWITCH && (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__)) && defined(__ELF__)
+#define JNK_HAS_JUMP_LABELS 1
+#else
+#define JNK_HAS_JUMP_LABELS 0
+#endif
+
+#if JUNK_RUNTIME_SWITCH
+#include <atomic>
+#include <mutex>
+#endif
+#if JNK_HAS_JUMP_LABELS
+#include <sys/mman.h>
+#include <unistd.h>
+// Bounds of this module's site table, provided by the linker. GNU ld still puts them in
+// .dynsym of a shared object; link it with a version script that makes them local
+// ({ local: __start_junk_jump_table; __stop_junk_jump_table; }; CMake does this).
+extern "C" {
+    extern const uintptr_t __start_junk_jump_table[] __attribute__((weak, visibility("hidden")));
+    extern const uintptr_t __stop_junk_jump_table[]  __attribute__((weak, visibility("hidden")));
+}
+#endif
+
+// -------- Pre-generated junk pool --------
+// JUNK_PREGENERATED: call sites only see declarations of the emitters and map onto one
+//   of JUNK_POOL_SIZE pool slots. The slots are explicitly instantiated in generated
+//   junk TUs (obfuscate.py --emit-junk-pool), which define JUNK_POOL_IMPL first.
+#ifndef JUNK_PREGENERATED
+#define JUNK_PREGENERATED 0
+#endif
+#ifndef JUNK_POOL_IMPL
+#define JUNK_POOL_IMPL 0
+#endif
+#ifndef JUNK_POOL_SIZE
+#define JUNK_POOL_SIZE 256
+#endif
+#define JUNK_POOL_CTR 0x3FFF
+#define JNK_DEFINE_PATTERNS (!JUNK_PREGENERATED || JUNK_POOL_IMPL)
+static_assert(!(JUNK_PREGENERATED && JUNK_FRAME_FREE),
+              "JUNK_FRAME_FREE inlines the emitters and cannot be combined with JUNK_PREGENERATED");
+
+// -------- Linkage --------
+// JUNK_INTERNAL_LINKAGE (default 1): patterns and per-site emitters get internal linkage,
+//   so each TU keeps its own copies -- no weak/COMDAT symbols for the linker to fold,
+//   and no per-TU seed mix-ups from folding emit<Line,Ctr> across files. Everything
+//   that must stay shared (pool emitters, the runtime switch) is hidden on GCC/Clang.
+#ifndef JUNK_INTERNAL_LINKAGE
+#define JUNK_INTERNAL_LINKAGE 1
+#endif
+#if JUNK_INTERNAL_LINKAGE
+#define JNK_LOCAL static inline
+#else
+#define JNK_LOCAL inline
+#endif
+
+#if JUNK_FRAME_FREE
+#define JNK_EMITTER JNK_FORCEINLINE
+#else
+#define JNK_EMITTER JNK_NOINLINE JNK_LOCAL
+#endif
+// Pooled emitters are plain templates so the call-site declarations match the definitions.
+#if JUNK_PREGENERATED
+#define JNK_EMITTER_TPL JNK_NOINLINE
+#else
+#define JNK_EMITTER_TPL JNK_EMITTER
+#endif
+
+// -------- Inline jump-over bytes --------
+// JUNK_INLINE_BYTES_MIN/MAX bound the byte run per site (the jump over it stays a short jmp).
+#ifndef JUNK_INLINE_BYTES_MIN
+#define JUNK_INLINE_BYTES_MIN 4
+#endif
+#ifndef JUNK_INLINE_BYTES_MAX
+#define JUNK_INLINE_BYTES_MAX 24
+#endif
+static_assert(JUNK_INLINE_BYTES_MIN <= JUNK_INLINE_BYTES_MAX && JUNK_INLINE_BYTES_MAX <= 120,
+              "JUNK_INLINE_BYTES_MAX must be >= MIN and <= 120");
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define JNK_HAS_INLINE_BYTES 1
+#else
+#define JNK_HAS_INLINE_BYTES 0
+#endif
+
+// Hidden by default for everything below (GCC/Clang); popped at the end of the header.
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC visibility push(hidden)
 #endif
 
 namespace junk_detail {
@@ -61,16 +209,23 @@ namespace junk_detail {
 #endif
     }
 
+    // JUNK_BUILD_SEED: fixed 32-bit seed used instead of __DATE__/__TIME__, so the same
+    // sources give the same objects and compiler caches (ccache, sccache) can hit.
+    // CMake derives it from OBFUSCATOR_SEED.
     constexpr uint32_t tu_seed() {
 #ifdef __FILE__
         uint32_t h = fnv1a32_cstr(__FILE__);
 #else
         uint32_t h = 0u;
 #endif
+#ifdef JUNK_BUILD_SEED
+        h ^= mix32(static_cast<uint32_t>(JUNK_BUILD_SEED));
+#else
 #ifdef __DATE__
         h ^= fnv1a32_cstr(__DATE__);
 #endif
         h ^= time_seed();
+#endif
         // extra tiny mix
         h ^= (h << 13); h ^= (h >> 17); h ^= (h << 5);
         return h;
@@ -86,10 +241,52 @@ namespace junk_detail {
     };
 
     template <typename T>
-    JNK_NOINLINE inline void keep(volatile T& v) { (void)v; }
+    JNK_NOINLINE JNK_LOCAL void keep(volatile T& v) { (void)v; }
+
+#if JNK_DEFINE_PATTERNS
+    // -------- Estimated stack cost (bytes) --------
+    // Conservative per-frame estimates used by the budget; measure the real numbers
+    // with -fstack-usage (see External/Script/stackusage.py).
+    namespace stack_cost {
+        constexpr size_t frame      = 2 * sizeof(void*);   // return address + saved frame pointer
+        constexpr size_t reg_mix    = sizeof(void*);       // leaf, no locals
+        constexpr size_t mix_u32    = frame + 2 * sizeof(uint32_t);
+        constexpr size_t arith_int  = frame + sizeof(int);
+        constexpr size_t fp_mix     = frame + sizeof(float) + sizeof(double);
+        constexpr size_t small_vec  = frame + 4 * sizeof(uint32_t);
+        constexpr size_t ptr_jiggle = frame + 32 + 16 + 3 * sizeof(uintptr_t); // scratch + align slack
+        constexpr size_t structs    = frame + 4 * sizeof(int);
+        // emit_heavy -> emit -> emit_core -> pattern -> keep
+        constexpr size_t chain      = 4 * frame;
+    }
+
+    constexpr bool fits(size_t pattern) {
+        return !JUNK_FRAME_FREE &&
+               (JUNK_STACK_BUDGET == 0 || stack_cost::chain + pattern <= static_cast<size_t>(JUNK_STACK_BUDGET));
+    }
+
+    // Sink for the frame-free pattern (a store to it cannot be eliminated).
+    JNK_LOCAL volatile uint32_t g_sink = 0;
+
+    // Frame-free pattern: register-only mixing, published through g_sink. Kept outside
+    // the MSVC optimize-off region so its locals stay in registers there too.
+    JNK_NOINLINE JNK_LOCAL void p_reg_mix(uint32_t s, int rounds) {
+        uint32_t a = s ^ 0x3C6EF372u;
+        uint32_t b = rotl(s, 11) + 0xA54FF53Au;
+        for (int i = 0; i < rounds; ++i) {
+            a = mix32(a + b);
+            b = xorshift32(b ^ a ^ static_cast<uint32_t>(i));
+        }
+        g_sink = a ^ b;
+    }
+
+// Disable optimizations for the pattern functions (MSVC needs file-scope pragma)
+#if defined(_MSC_VER)
+#pragma optimize("", off)
+#endif
 
     // -------- Pattern pieces (small, different-looking blocks) --------
-    JNK_NOINLINE inline void p_mix_u32(uint32_t s, int rounds) {
+    JNK_NOINLINE JNK_LOCAL void p_mix_u32(uint32_t s, int rounds) {
         volatile uint32_t a = s ^ 0xA5A5A5A5u;
         volatile uint32_t b = s + 0x7F4A7C15u;
         for (int i = 0; i < rounds; ++i) {
@@ -101,7 +298,7 @@ namespace junk_detail {
         keep(a); keep(b);
     }
 
-    JNK_NOINLINE inline void p_arith_int(uint32_t s, int n) {
+    JNK_NOINLINE JNK_LOCAL void p_arith_int(uint32_t s, int n) {
         volatile int x = static_cast<int>(s ^ 0xDEADBEEFu);
         for (int i = 0; i < n; ++i) {
             x ^= (x << 7);
@@ -112,7 +309,7 @@ namespace junk_detail {
         keep(x);
     }
 
-    JNK_NOINLINE inline void p_fp_mix(uint32_t s, int n) {
+    JNK_NOINLINE JNK_LOCAL void p_fp_mix(uint32_t s, int n) {
         volatile float  f = (static_cast<int>(s) & 0x7FFF) * 1.0009765625f; // ~/1024
         volatile double d = (static_cast<int>(rotl(s, 9)) & 0xFFFF) * 0.0001220703125; // ~/8192
         for (int i = 0; i < n; ++i) {
@@ -124,7 +321,7 @@ namespace junk_detail {
         keep(f); keep(d);
     }
 
-    JNK_NOINLINE inline void p_small_vec(uint32_t s) {
+    JNK_NOINLINE JNK_LOCAL void p_small_vec(uint32_t s) {
         volatile uint32_t v[4] = {
             mix32(s + 0x100u), mix32(s + 0x200u), mix32(s + 0x300u), mix32(s + 0x400u)
         };
@@ -138,7 +335,7 @@ namespace junk_detail {
         keep(v[0]); keep(v[1]); keep(v[2]); keep(v[3]);
     }
 
-    JNK_NOINLINE inline void p_ptr_jiggle(uint32_t s) {
+    JNK_NOINLINE JNK_LOCAL void p_ptr_jiggle(uint32_t s) {
         // simulate pointer math without touching real memory
         alignas(16) volatile uint8_t scratch[32] = {};
         volatile uintptr_t p = reinterpret_cast<uintptr_t>(&scratch[0]) ^ (static_cast<uintptr_t>(s) << 1);
@@ -149,7 +346,7 @@ namespace junk_detail {
     }
 
     // Compile-time (template) variant — use only when K is a constant expression
-    template<int K> JNK_NOINLINE inline void p_structs() {
+    template<int K> JNK_NOINLINE JNK_LOCAL void p_structs() {
         struct S { int a; unsigned b; short c; unsigned char d; };
         volatile S s = { static_cast<int>(0x12345678u ^ K), static_cast<unsigned>(0x9E3779B9u * (K + 1)),
                          static_cast<short>((K * 73) & 0x7FFF), static_cast<unsigned char>((K * 37) & 0xFF) };
@@ -158,7 +355,7 @@ namespace junk_detail {
     }
 
     // Runtime variant — for when K is not a constant expression
-    JNK_NOINLINE inline void p_structs_rt(int K) {
+    JNK_NOINLINE JNK_LOCAL void p_structs_rt(int K) {
         struct S { int a; unsigned b; short c; unsigned char d; };
         volatile S s = { static_cast<int>(0x12345678u ^ K), static_cast<unsigned>(0x9E3779B9u * (K + 1)),
                          static_cast<short>((K * 73) & 0x7FFF), static_cast<unsigned char>((K * 37) & 0xFF) };
@@ -167,22 +364,24 @@ namespace junk_detail {
     }
 
     // -------- core emitter building block --------
-    JNK_NOINLINE inline void emit_core(uint32_t S, int r0, int r1, uint32_t sel) {
+    // Patterns over the stack budget fall back to p_reg_mix (folded at compile time).
+    JNK_EMITTER void emit_core(uint32_t S, int r0, int r1, uint32_t sel) {
         switch (sel & 7u) {
-        case 0: p_mix_u32(S ^ 0x11111111u, r0 + 2); break;
-        case 1: p_arith_int(S ^ 0x22222222u, r1);   break;
-        case 2: p_fp_mix(S ^ 0x33333333u, r0 + r1); break;
-        case 3: p_small_vec(S ^ 0x44444444u);       break;
-        case 4: p_ptr_jiggle(S ^ 0x55555555u);      break;
-        case 5: p_structs_rt(static_cast<int>(0x155 ^ ((S >> 10) & 0x3FF))); break; // runtime K
-        case 6: p_structs_rt(static_cast<int>(0x2AA ^ ((S >> 11) & 0x7FF))); break; // runtime K
-        default: p_mix_u32(S ^ 0x66666666u, r0);   break;
+        case 0: if (fits(stack_cost::mix_u32))    { p_mix_u32(S ^ 0x11111111u, r0 + 2); return; } break;
+        case 1: if (fits(stack_cost::arith_int))  { p_arith_int(S ^ 0x22222222u, r1);   return; } break;
+        case 2: if (fits(stack_cost::fp_mix))     { p_fp_mix(S ^ 0x33333333u, r0 + r1); return; } break;
+        case 3: if (fits(stack_cost::small_vec))  { p_small_vec(S ^ 0x44444444u);       return; } break;
+        case 4: if (fits(stack_cost::ptr_jiggle)) { p_ptr_jiggle(S ^ 0x55555555u);      return; } break;
+        case 5: if (fits(stack_cost::structs))    { p_structs_rt(static_cast<int>(0x155 ^ ((S >> 10) & 0x3FF))); return; } break; // runtime K
+        case 6: if (fits(stack_cost::structs))    { p_structs_rt(static_cast<int>(0x2AA ^ ((S >> 11) & 0x7FF))); return; } break; // runtime K
+        default: if (fits(stack_cost::mix_u32))   { p_mix_u32(S ^ 0x66666666u, r0);   return; } break;
         }
+        p_reg_mix(S, r0);
     }
 
     // -------- Dispatcher: varies shape *and amount* per site/build --------
     template<int Line, int Ctr>
-    JNK_NOINLINE inline void emit() {
+    JNK_EMITTER_TPL void emit() {
         constexpr uint32_t S0 = site_seed<Line, Ctr>::value;
         constexpr uint32_t S1 = mix32(S0 ^ 0x85EBCA6Bu);
         constexpr uint32_t S2 = mix32(S1 ^ 0xC2B2AE35u);
@@ -199,15 +398,15 @@ namespace junk_detail {
             const int r1 = r1_base + static_cast<int>((Si >> 23) & 3);
             emit_core(Si, r0, r1, (S0 ^ S1 ^ S2 ^ (Si << 3)));
 
-            if (sec_mask & (1u << (i & 7)))        p_small_vec(Si ^ 0xA5A5A5A5u);
-            if (sec_mask & (1u << ((i + 3) & 7)))    p_ptr_jiggle(Si ^ 0x7F4A7C15u);
-            if (sec_mask & (1u << ((i + 5) & 7)))    p_fp_mix(Si ^ 0xC3ECEB5Du, 1 + (Si & 3));
+            if (fits(stack_cost::small_vec)  && (sec_mask & (1u << (i & 7))))       p_small_vec(Si ^ 0xA5A5A5A5u);
+            if (fits(stack_cost::ptr_jiggle) && (sec_mask & (1u << ((i + 3) & 7)))) p_ptr_jiggle(Si ^ 0x7F4A7C15u);
+            if (fits(stack_cost::fp_mix)     && (sec_mask & (1u << ((i + 5) & 7)))) p_fp_mix(Si ^ 0xC3ECEB5Du, 1 + (Si & 3));
         }
     }
 
     // Heavier variant (stacks more blocks based on seed)
     template<int Line, int Ctr>
-    JNK_NOINLINE inline void emit_heavy() {
+    JNK_EMITTER_TPL void emit_heavy() {
         constexpr uint32_t Sx = site_seed<Line, Ctr>::value;
         constexpr int extra = 1 + static_cast<int>(((Sx >> 22) & 7)); // 1..8 extra cores
         emit<Line, Ctr>();
@@ -216,10 +415,166 @@ namespace junk_detail {
             const int r0 = 1 + static_cast<int>((Sk >> 20) & 7);
             const int r1 = 2 + static_cast<int>((Sk >> 23) & 7);
             emit_core(Sk, r0, r1, (Sk ^ (Sx << 1) ^ 0xDEADBEEFu));
-            if (Sk & 0x00004000u) p_arith_int(Sk ^ 0x12345678u, 2 + static_cast<int>((Sk >> 17) & 3));
+            if (fits(stack_cost::arith_int) && (Sk & 0x00004000u)) p_arith_int(Sk ^ 0x12345678u, 2 + static_cast<int>((Sk >> 17) & 3));
         }
     }
 
+    // -------- Branch-free variants (JUNK_BRANCHLESS) --------
+    // Trip counts are template arguments and every step is expanded with a fold
+    // expression, so the blocks contain no loop back-edges and no conditional jumps.
+    // Each step is a forceinline function of its index, so the folds only sequence void
+    // calls (using the value of a volatile assignment is deprecated in C++20).
+    template<size_t I>
+    JNK_FORCEINLINE void bl_mix_u32_step(volatile uint32_t& a, volatile uint32_t& b) {
+        a = mix32(a + static_cast<uint32_t>(I * 2654435761u));
+        b = xorshift32(b ^ a ^ static_cast<uint32_t>(I * 1013904223u));
+        if constexpr ((I & 1) == 0) a = a ^ rotr(b, (I & 31));
+        else                        b = b ^ rotl(a, ((I * 3) & 31));
+    }
+    template<int N, size_t... I>
+    JNK_NOINLINE JNK_LOCAL void bl_mix_u32_impl(uint32_t s, std::index_sequence<I...>) {
+        volatile uint32_t a = s ^ 0xA5A5A5A5u;
+        volatile uint32_t b = s + 0x7F4A7C15u;
+        (bl_mix_u32_step<I>(a, b), ...);
+        keep(a); keep(b);
+    }
+    template<int N> JNK_LOCAL void bl_mix_u32(uint32_t s) { bl_mix_u32_impl<N>(s, std::make_index_sequence<N>{}); }
+
+    template<size_t I>
+    JNK_FORCEINLINE void bl_arith_int_step(volatile int& x, uint32_t s) {
+        x = x ^ (x << 7);
+        x = x + static_cast<int>(0x9E3779B9u + (s ^ static_cast<uint32_t>(I)));
+        x = x ^ (x >> 13);
+        x = x * static_cast<int>(0x10001 + (I & 3));
+    }
+    template<int N, size_t... I>
+    JNK_NOINLINE JNK_LOCAL void bl_arith_int_impl(uint32_t s, std::index_sequence<I...>) {
+        volatile int x = static_cast<int>(s ^ 0xDEADBEEFu);
+        (bl_arith_int_step<I>(x, s), ...);
+        keep(x);
+    }
+    template<int N> JNK_LOCAL void bl_arith_int(uint32_t s) { bl_arith_int_impl<N>(s, std::make_index_sequence<N>{}); }
+
+    template<size_t I>
+    JNK_FORCEINLINE void bl_fp_mix_step(volatile float& f, volatile double& d, uint32_t s) {
+        f = f * (1.0f + ((s >> (I & 7)) & 7) * 0.03125f) - 0.0625f;
+        d = d + (((s >> ((I + 3) & 7)) & 15) * 0.0078125) - 0.00390625;
+        if constexpr ((I & 1) != 0) f = f * 1.41421356f - 0.70710678f;
+        else                        d = d * 1.7320508075688772 - 0.5773502691896258;
+    }
+    template<int N, size_t... I>
+    JNK_NOINLINE JNK_LOCAL void bl_fp_mix_impl(uint32_t s, std::index_sequence<I...>) {
+        volatile float  f = (static_cast<int>(s) & 0x7FFF) * 1.0009765625f;
+        volatile double d = (static_cast<int>(rotl(s, 9)) & 0xFFFF) * 0.0001220703125;
+        (bl_fp_mix_step<I>(f, d, s), ...);
+        keep(f); keep(d);
+    }
+    template<int N> JNK_LOCAL void bl_fp_mix(uint32_t s) { bl_fp_mix_impl<N>(s, std::make_index_sequence<N>{}); }
+
+    // index math instead of swaps-under-condition: data-dependent addressing, no branches
+    template<size_t I>
+    JNK_FORCEINLINE void bl_small_vec_step(volatile uint32_t (&v)[4], uint32_t s) {
+        const uint32_t a = (s + I) & 3, b = ((s >> (I & 3)) + I) & 3;
+        v[a] = v[a] ^ rotl(v[b], (I * 5) & 31);
+        v[b] = v[b] + (0x9E3779B9u ^ static_cast<uint32_t>(I * 2654435761u));
+    }
+    template<size_t... I>
+    JNK_NOINLINE JNK_LOCAL void bl_small_vec_impl(uint32_t s, std::index_sequence<I...>) {
+        volatile uint32_t v[4] = {
+            mix32(s + 0x100u), mix32(s + 0x200u), mix32(s + 0x300u), mix32(s + 0x400u)
+        };
+        (bl_small_vec_step<I>(v, s), ...);
+        keep(v[0]); keep(v[1]); keep(v[2]); keep(v[3]);
+    }
+    JNK_LOCAL void bl_small_vec(uint32_t s) { bl_small_vec_impl(s, std::make_index_sequence<7>{}); }
+
+    // Frame-free, branch-free fallback for the stack budget
+    template<size_t I>
+    JNK_FORCEINLINE void bl_reg_mix_step(uint32_t& a, uint32_t& b) {
+        a = mix32(a + b);
+        b = xorshift32(b ^ a ^ static_cast<uint32_t>(I));
+    }
+    template<size_t... I>
+    JNK_NOINLINE JNK_LOCAL void bl_reg_mix_impl(uint32_t s, std::index_sequence<I...>) {
+        uint32_t a = s ^ 0x3C6EF372u;
+        uint32_t b = rotl(s, 11) + 0xA54FF53Au;
+        (bl_reg_mix_step<I>(a, b), ...);
+        g_sink = a ^ b;
+    }
+    template<int N> JNK_LOCAL void bl_reg_mix(uint32_t s) { bl_reg_mix_impl(s, std::make_index_sequence<N>{}); }
+
+    // Pattern choice resolved with if constexpr: one direct call per block.
+    template<uint32_t S>
+    JNK_FORCEINLINE void bl_core() {
+        constexpr int r0 = 1 + static_cast<int>((S >> 21) & 7); // 1..8
+        constexpr int r1 = 2 + static_cast<int>((S >> 24) & 7); // 2..9
+        constexpr uint32_t sel = (S ^ (S >> 13)) % 6u;
+        if constexpr (sel == 0 && fits(stack_cost::mix_u32))         bl_mix_u32<r0 + 2>(S ^ 0x11111111u);
+        else if constexpr (sel == 1 && fits(stack_cost::arith_int))  bl_arith_int<r1>(S ^ 0x22222222u);
+        else if constexpr (sel == 2 && fits(stack_cost::fp_mix))     bl_fp_mix<r0 + 1>(S ^ 0x33333333u);
+        else if constexpr (sel == 3 && fits(stack_cost::small_vec))  bl_small_vec(S ^ 0x44444444u);
+        else if constexpr (sel == 4 && fits(stack_cost::ptr_jiggle)) p_ptr_jiggle(S ^ 0x55555555u);        // already straight-line
+        else if constexpr (sel == 5 && fits(stack_cost::structs))    p_structs_rt(static_cast<int>(0x155 ^ ((S >> 10) & 0x3FF)));
+        else                                                         bl_reg_mix<r0>(S);
+    }
+
+    template<uint32_t S0, uint32_t Mul, size_t... I>
+    JNK_FORCEINLINE void bl_blocks(std::index_sequence<I...>) {
+        (bl_core<mix32(S0 + static_cast<uint32_t>(I) * Mul)>(), ...);
+    }
+
+    template<int Line, int Ctr>
+    JNK_EMITTER_TPL void emit_branchless() {
+        constexpr uint32_t S0 = site_seed<Line, Ctr>::value;
+        constexpr uint32_t S2 = mix32(mix32(S0 ^ 0x85EBCA6Bu) ^ 0xC2B2AE35u);
+        constexpr int repeats = 1 + static_cast<int>((S2 >> 28) & 3); // 1..4
+        bl_blocks<S0, 0x9E3779B9u>(std::make_index_sequence<repeats>{});
+    }
+
+    template<int Line, int Ctr>
+    JNK_EMITTER_TPL void emit_branchless_heavy() {
+        constexpr uint32_t Sx = site_seed<Line, Ctr>::value;
+        constexpr int extra = 1 + static_cast<int>(((Sx >> 22) & 7)); // 1..8 extra blocks
+        emit_branchless<Line, Ctr>();
+        bl_blocks<Sx, 0x27D4EB2Du>(std::make_index_sequence<extra>{});
+    }
+
+#else
+    // Pre-generated build: the bodies live in the junk pool TUs.
+    template<int Line, int Ctr> JNK_EMITTER_TPL void emit();
+    template<int Line, int Ctr> JNK_EMITTER_TPL void emit_heavy();
+    template<int Line, int Ctr> JNK_EMITTER_TPL void emit_branchless();
+    template<int Line, int Ctr> JNK_EMITTER_TPL void emit_branchless_heavy();
+#endif // JNK_DEFINE_PATTERNS
+
+#if JNK_HAS_INLINE_BYTES
+    // Emitted straight into the caller: "jmp 1f", then a run of bytes drawn by the
+    // assembler from an LCG seeded with S -- about half common opcode/prefix bytes
+    // (REX.W, mov, call, 0F escape, FF group, 83/C7 imm forms), the rest operand-like.
+    // The bytes are never executed; the only runtime cost is the taken direct jump.
+    template<uint32_t S>
+    JNK_FORCEINLINE void inline_bytes() {
+        constexpr uint32_t span = JUNK_INLINE_BYTES_MAX - JUNK_INLINE_BYTES_MIN + 1;
+        __asm__ __volatile__(
+            "jmp 1f\n\t"
+            ".set .Ljnk_s, %c0\n\t"
+            ".rept %c1\n\t"
+            ".set .Ljnk_s, (.Ljnk_s * 1103515245 + 12345) & 0x7fffffff\n\t"
+            ".set .Ljnk_i, (.Ljnk_s >> 16) & 7\n\t"
+            ".if (.Ljnk_s >> 28) & 1\n\t"
+            ".byte (.Ljnk_s >> 8) & 0xff\n\t"
+            ".elseif .Ljnk_i < 4\n\t"
+            ".byte (0xE88B8948 >> (.Ljnk_i * 8)) & 0xff\n\t"
+            ".else\n\t"
+            ".byte (0xC783FF0F >> ((.Ljnk_i - 4) * 8)) & 0xff\n\t"
+            ".endif\n\t"
+            ".endr\n"
+            "1:"
+            :
+            : "i"(S & 0x7FFFFFFFu), "i"(JUNK_INLINE_BYTES_MIN + S % span));
+    }
+#endif
+
 } // namespace junk_detail
 
 // Re-enable optimizations after the pattern functions (MSVC only)
@@ -227,11 +582,194 @@ namespace junk_detail {
 #pragma optimize("", on)
 #endif
 
+// -------- Site wrappers (optimized on MSVC too, so the gates stay cheap) --------
+namespace junk_detail {
+
+#if JUNK_ADAPTIVE
+    // 6 bytes per site and thread. The stamp is a 16-bit millisecond clock, so a window
+    // spanning more than ~65 s may be misread once; the next window corrects it.
+    struct rate_state {
+        uint16_t calls;
+        uint16_t stamp;
+        uint8_t  mode;   // 0 = no stamp yet, 1 = cold (junk runs), 2 = hot (junk skipped)
+    };
+
+    // Keyed by the site seed (call site + TU), not by Line/Ctr alone.
+    // TLS model: executables (non-PIC or PIE) get local-exec, one %fs-relative access.
+    // Shared objects get JUNK_ADAPTIVE_TLS_MODEL, local-dynamic by default: the library
+    // stays dlopen-safe and each check finds the module's TLS block through
+    // __tls_get_addr (or a TLS descriptor with -mtls-dialect=gnu2). "initial-exec" makes
+    // it a single load, but puts every site in the static TLS block: only for libraries
+    // loaded at startup, as dlopen fails once a few hundred sites exhaust its surplus.
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__PIC__) && !defined(__PIE__)
+#define JNK_TLS_MODEL __attribute__((tls_model(JUNK_ADAPTIVE_TLS_MODEL)))
+#else
+#define JNK_TLS_MODEL
+#endif
+    template<uint32_t Seed>
+    JNK_LOCAL thread_local rate_state tl_rate JNK_TLS_MODEL = {};
+
+    inline uint16_t coarse_ms() {
+        using namespace std::chrono;
+        return static_cast<uint16_t>(duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count());
+    }
+
+    template<uint32_t Seed>
+    JNK_FORCEINLINE bool adaptive_allow() {
+        rate_state& st = tl_rate<Seed>;
+        if (++st.calls < JUNK_ADAPTIVE_WINDOW) return st.mode != 2;
+        const uint16_t now = coarse_ms();
+        const uint32_t elapsed = static_cast<uint16_t>(now - st.stamp);
+        // calls/s > MAX_CPS  <=>  WINDOW * 1000 > MAX_CPS * elapsed_ms
+        const bool hot = st.mode != 0 &&
+            static_cast<uint64_t>(JUNK_ADAPTIVE_WINDOW) * 1000u > static_cast<uint64_t>(JUNK_ADAPTIVE_MAX_CPS) * elapsed;
+        st.mode = hot ? 2 : 1;
+        st.stamp = now;
+        st.calls = 0;
+        return !hot;
+    }
+#endif
+
+#if JUNK_RUNTIME_SWITCH
+    inline std::atomic<bool> g_enabled{ true };
+
+#if JNK_HAS_JUMP_LABELS
+#if defined(__x86_64__)
+#define JNK_ASM_PTR ".quad"
+#else
+#define JNK_ASM_PTR ".long"
+#endif
+    constexpr uint8_t kSiteOn  = 0xE9; // jmp rel32
+    constexpr uint8_t kSiteOff = 0x3D; // cmp eax, imm32 (same 4-byte tail)
+
+    // Records the address of the 5-byte gate in junk_jump_table. The "?" flag keeps
+    // the entry in the caller's COMDAT group, so discarded inline copies drop theirs.
+    JNK_FORCEINLINE bool site_enabled() {
+        asm goto("1: .byte 0xE9\n\t"
+                 ".long %l[on] - 2f\n"
+                 "2:\n\t"
+                 ".pushsection junk_jump_table, \"aw?\"\n\t"
+                 ".balign %c0\n\t"
+                 JNK_ASM_PTR " 1b\n\t"
+                 ".popsection"
+                 : : "i"(sizeof(void*)) : "cc" : on);
+        return false;
+    on:
+        return true;
+    }
+
+    // Rewrites the first byte of every gate in this module; single-byte stores keep
+    // each site either fully on or fully off for threads running through it. All gates
+    // live in this module's executable segment, so one mprotect over the pages spanning
+    // them either opens every site or none: on failure nothing is patched.
+    inline bool patch_sites(bool on) {
+        const uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        const uint8_t want = on ? kSiteOn : kSiteOff;
+        uintptr_t lo = UINTPTR_MAX, hi = 0;
+        for (const uintptr_t* e = __start_junk_jump_table; e && e != __stop_junk_jump_table; ++e) {
+            if (*reinterpret_cast<const volatile uint8_t*>(*e) == want) continue;
+            if (*e < lo) lo = *e;
+            if (*e > hi) hi = *e;
+        }
+        if (lo > hi) return true;
+        lo &= ~(page - 1);
+        const size_t len = ((hi + 1 - lo) + page - 1) & ~(page - 1);
+        if (mprotect(reinterpret_cast<void*>(lo), len, PROT_READ | PROT_WRITE | PROT_EXEC) != 0)
+            return false;
+        for (const uintptr_t* e = __start_junk_jump_table; e != __stop_junk_jump_table; ++e)
+            *reinterpret_cast<volatile uint8_t*>(*e) = want;
+        mprotect(reinterpret_cast<void*>(lo), len, PROT_READ | PROT_EXEC);
+        return true;
+    }
+#else
+    JNK_FORCEINLINE bool site_enabled() { return g_enabled.load(std::memory_order_relaxed); }
+#endif
+
+    // Turns junk execution on/off for every site in this module. The switch, the site table
+    // and this function are hidden, so each executable or shared object that includes this
+    // header has its own: call it in every module whose junk should change.
+    // Returns false, and leaves every site and is_enabled() as they were, if some code pages
+    // could not be made writable (mprotect refused, e.g. under W^X or SELinux execmod rules).
+    [[nodiscard]] inline bool set_enabled(bool on) {
+        static std::mutex m;
+        std::lock_guard<std::mutex> lock(m);
+#if JNK_HAS_JUMP_LABELS
+        if (!patch_sites(on)) return false;
+#endif
+        g_enabled.store(on, std::memory_order_relaxed);
+        return true;
+    }
+
+    inline bool is_enabled() { return g_enabled.load(std::memory_order_relaxed); }
+#endif
+
+    template<int Line, int Ctr>
+    JNK_FORCEINLINE void run_site() {
+#if JUNK_RUNTIME_SWITCH
+        if (!site_enabled()) return;
+#endif
+#if JUNK_ADAPTIVE
+        if (!adaptive_allow<site_seed<Line, Ctr>::value>()) return;
+#endif
+#if JUNK_PREGENERATED
+        constexpr int L = static_cast<int>(site_seed<Line, Ctr>::value % JUNK_POOL_SIZE), C = JUNK_POOL_CTR;
+#else
+        constexpr int L = Line, C = Ctr;
+#endif
+#if JUNK_BRANCHLESS
+        emit_branchless<L, C>();
+#else
+        emit<L, C>();
+#endif
+    }
+
+    template<int Line, int Ctr>
+    JNK_FORCEINLINE void run_site_heavy() {
+#if JUNK_RUNTIME_SWITCH
+        if (!site_enabled()) return;
+#endif
+#if JUNK_ADAPTIVE
+        if (!adaptive_allow<site_seed<Line, Ctr>::value>()) return;
+#endif
+#if JUNK_PREGENERATED
+        constexpr int L = static_cast<int>(site_seed<Line, Ctr>::value % JUNK_POOL_SIZE), C = JUNK_POOL_CTR;
+#else
+        constexpr int L = Line, C = Ctr;
+#endif
+#if JUNK_BRANCHLESS
+        emit_branchless_heavy<L, C>();
+#else
+        emit_heavy<L, C>();
+#endif
+    }
+
+} // namespace junk_detail
+
 // -------- Public macros --------
 // Unique per call site via __LINE__/__COUNTER__, and per build/TU via __TIME__/__DATE__/__FILE__.
-// Each build → different binary bytes (hash) as long as reproducible-build modes don't fix time/date.
-#define JUNK_CODE_BLOCK()          ::junk_detail::emit<__LINE__, (__COUNTER__ & 0x3FFF)>()
-#define JUNK_CODE_BLOCK_ADVANCED() ::junk_detail::emit_heavy<__LINE__, ((__COUNTER__ + 11) & 0x3FFF)>()
+// Each build → different binary bytes (hash) as long as reproducible-build modes don't fix time/date
+// and JUNK_BUILD_SEED is not set.
+// Mode selection (branchless / adaptive) happens in run_site / run_site_heavy.
+#define JUNK_CODE_BLOCK()          ::junk_detail::run_site<__LINE__, (__COUNTER__ & 0x3FFF)>()
+#define JUNK_CODE_BLOCK_ADVANCED() ::junk_detail::run_site_heavy<__LINE__, ((__COUNTER__ + 11) & 0x3FFF)>()
+
+// Explicit instantiations for one pool slot (used by the generated junk TUs).
+#if JUNK_BRANCHLESS
+#define JUNK_POOL_ENTRY(I) \
+    template void junk_detail::emit_branchless<(I), JUNK_POOL_CTR>(); \
+    template void junk_detail::emit_branchless_heavy<(I), JUNK_POOL_CTR>();
+#else
+#define JUNK_POOL_ENTRY(I) \
+    template void junk_detail::emit<(I), JUNK_POOL_CTR>(); \
+    template void junk_detail::emit_heavy<(I), JUNK_POOL_CTR>();
+#endif
+
+// Zero-execution-cost variant: bytes jumped over inline (no-op where inline asm is unavailable).
+#if JNK_HAS_INLINE_BYTES
+#define JUNK_INLINE_BYTES() ::junk_detail::inline_bytes<::junk_detail::site_seed<__LINE__, (__COUNTER__ & 0x3FFF)>::value>()
+#else
+#define JUNK_INLINE_BYTES() ((void)0)
+#endif
 
 // -------- Size-jitter pad (ensures DLL/EXE size changes across builds) --------
 // Purpose: even if code-size stays in the same PE alignment bucket, vary file size by
@@ -260,3 +798,7 @@ extern "C" __declspec(selectany) int rjunk_anchor = 0;
 __attribute__((section(".rjunk,\"a\""), used, aligned(16)))
 const unsigned char g_rjunk_pad_gcc[junk_detail::RJUNK_SZ] = { 1 };
 #endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC visibility pop
+#endif
@@ -2,6 +2,7 @@
 #pragma once
 #include <array>
 #include <string>
+#include <string_view>
 #include <cstdint>
 #include <iostream>
 #include <algorithm>
@@ -23,6 +24,11 @@ namespace StringObfuscator {
         x ^= x << 13; x ^= x >> 17; x ^= x << 5; return x;
     }
 
+    // key of an N-byte literal encrypted with SEED (obfuscate.py --string-table computes the same)
+    constexpr uint32_t StringKey(uint32_t seed, std::size_t n) {
+        return mix32(seed * 0x9E3779B1u + static_cast<uint32_t>(n));
+    }
+
     // --------- Layer 1 ----------
     template <std::size_t N, uint32_t SEED>
     constexpr auto Layer1_XOR(const char(&str)[N]) {
@@ -61,7 +67,7 @@ namespace StringObfuscator {
         std::array<uint8_t, N> out = in;
         if constexpr (N > 1) {
             for (std::size_t i = N - 1; i > 0; --i) {
-                const std::size_t j = (static_cast<std::size_t>(SEED) * (i + 1)) % (i + 1);
+                const std::size_t j = static_cast<std::size_t>((static_cast<uint64_t>(SEED) * (i + 1)) % (i + 1));
                 cswap(out[i], out[j]);
             }
         }
@@ -102,24 +108,10 @@ namespace StringObfuscator {
         return out;
     }
 
-    template <std::size_t N, uint32_t SEED>
-    constexpr auto Layer5_AsciiBreaker_Dec(const std::array<uint8_t, N>& in) {
-        (void)SEED;
-        std::array<uint8_t, N> out{};
-        for (std::size_t i = 0; i < N; ++i) {
-            uint8_t e = in[i];
-            uint8_t t = static_cast<uint8_t>((i * 139u) & 0xFFu);
-            uint8_t d = static_cast<uint8_t>((e ^ 0xA5u) ^ t);
-            d = static_cast<uint8_t>(d - 101u);
-            out[i] = mul197_inv(d);
-        }
-        return out;
-    }
-
     // --------- Compile-time encryption (no pointers, all constexpr) ----------
     template <std::size_t N, uint32_t SEED>
     constexpr auto ObfuscateString(const char(&str)[N]) {
-        constexpr uint32_t K = mix32(SEED * 0x9E3779B1u + static_cast<uint32_t>(N));
+        constexpr uint32_t K = StringKey(SEED, N);
         const auto l1 = Layer1_XOR<N, K>(str);
         const auto l2 = Layer2_BitRotate<N, K>(l1);
         const auto l3 = Layer3_Shuffle<N, K>(l2);
@@ -127,36 +119,34 @@ namespace StringObfuscator {
         return Layer5_AsciiBreaker_Enc<N, K>(l4); // NEW final layer
     }
 
-    // --------- Runtime decryption (needs the same SEED) ----------
-    template <std::size_t N, uint32_t SEED>
-    std::string DecryptString(const std::array<uint8_t, N>& enc) {
-        constexpr uint32_t K = mix32(SEED * 0x9E3779B1u + static_cast<uint32_t>(N));
+    // --------- Runtime decryption (needs the same key) ----------
+    // Writes the n decrypted bytes (terminator included) of enc, encrypted with key K, to out.
+    inline void DecryptBytes(const uint8_t* enc, std::size_t n, uint32_t K, char* out) {
+        uint8_t* data = reinterpret_cast<uint8_t*>(out);
 
         // undo Layer5 first
-        std::array<uint8_t, N> data = Layer5_AsciiBreaker_Dec<N, K>(enc);
+        for (std::size_t i = 0; i < n; ++i) {
+            const uint8_t t = static_cast<uint8_t>((i * 139u) & 0xFFu);
+            const uint8_t d = static_cast<uint8_t>((enc[i] ^ 0xA5u) ^ t);
+            data[i] = mul197_inv(static_cast<uint8_t>(d - 101u));
+        }
 
         // undo Layer4
-        for (auto& c : data) c = rotl8(c, 2);
-        for (auto& c : data) c = static_cast<uint8_t>(~c);
-        for (std::size_t i = 0; i < N; ++i) data[i] = static_cast<uint8_t>(data[i] ^ static_cast<uint8_t>((K + i) & 0xFFu));
-
-        // undo Layer3
-        for (auto& c : data) c = static_cast<uint8_t>((c ^ 42u) - 13u);
-        std::array<std::size_t, N> idx{};
-        for (std::size_t i = 0; i < N; ++i) idx[i] = i;
-        if constexpr (N > 1) {
-            for (std::size_t i = N - 1; i > 0; --i) {
-                const std::size_t j = (static_cast<std::size_t>(K) * (i + 1)) % (i + 1);
-                cswap(idx[i], idx[j]);
-            }
+        for (std::size_t i = 0; i < n; ++i) {
+            const uint8_t c = static_cast<uint8_t>(~rotl8(data[i], 2));
+            data[i] = static_cast<uint8_t>(c ^ static_cast<uint8_t>((K + i) & 0xFFu));
+        }
+
+        // undo Layer3: byte tweak, then the swaps in reverse order
+        for (std::size_t i = 0; i < n; ++i) data[i] = static_cast<uint8_t>((data[i] ^ 42u) - 13u);
+        for (std::size_t i = 1; i < n; ++i) {
+            const std::size_t j = static_cast<std::size_t>((static_cast<uint64_t>(K) * (i + 1)) % (i + 1));
+            cswap(data[i], data[j]);
         }
-        std::array<uint8_t, N> unshuf{};
-        for (std::size_t i = 0; i < N; ++i) unshuf[idx[i]] = data[i];
-        data = unshuf;
 
         // undo Layer2
         const unsigned base = static_cast<unsigned>(K % 7u) + 1u;
-        for (std::size_t i = 0; i < N; ++i) {
+        for (std::size_t i = 0; i < n; ++i) {
             uint8_t c = data[i];
             c ^= (i % 2 == 0) ? uint8_t{ 0xAA } : uint8_t{ 0x55 };
             const unsigned r = (base + static_cast<unsigned>(i)) % 7u + 1u;
@@ -164,17 +154,25 @@ namespace StringObfuscator {
         }
 
         // undo Layer1
-        std::string out; out.resize(N);
         const uint64_t key1 = (static_cast<uint64_t>(K) * 0x100000001B3ull) ^ 0xDEADBEEFull;
         const uint64_t key2 = (static_cast<uint64_t>(K) * 0x1000000001B3ull) ^ 0xCAFEBABEull;
-        for (std::size_t i = 0; i < N; ++i) {
-            uint8_t c = data[i];
+        for (std::size_t i = 0; i < n; ++i) {
             const unsigned s1 = static_cast<unsigned>((i * 8u) % 56u);
             const unsigned s2 = static_cast<unsigned>((i * 3u) % 56u);
-            c ^= static_cast<uint8_t>((key2 >> s2) & 0xFFu);
-            c ^= static_cast<uint8_t>((key1 >> s1) & 0xFFu);
-            out[i] = static_cast<char>(c);
+            data[i] ^= static_cast<uint8_t>((key2 >> s2) & 0xFFu);
+            data[i] ^= static_cast<uint8_t>((key1 >> s1) & 0xFFu);
         }
+    }
+
+    template <std::size_t N, uint32_t SEED>
+    void DecryptInto(const std::array<uint8_t, N>& enc, char* out) {
+        DecryptBytes(enc.data(), N, StringKey(SEED, N), out);
+    }
+
+    template <std::size_t N, uint32_t SEED>
+    std::string DecryptString(const std::array<uint8_t, N>& enc) {
+        std::string out; out.resize(N);
+        DecryptInto<N, SEED>(enc, &out[0]);
         return out;
     }
 
@@ -200,6 +198,57 @@ namespace StringObfuscator {
         ObfuscatedString& operator=(const ObfuscatedString&) = delete;
     };
 
+    // Zeroes plaintext through volatile, so the stores survive even though the buffer
+    // is about to die.
+    inline void WipePlaintext(char* p, std::size_t n) {
+        volatile char* v = p;
+        for (std::size_t i = 0; i < n; ++i) v[i] = 0;
+    }
+
+    // --------- Stack-decrypted temporary for string_view sinks (OBS_VIEW) ----------
+    // The plaintext lives only in this object, i.e. until the end of the full-expression,
+    // and is wiped by the destructor; nothing is cached and nothing is allocated.
+    template <std::size_t N>
+    class DecryptedView {
+        std::array<char, N> buf_;
+    public:
+        DecryptedView(const uint8_t* enc, uint32_t K) { DecryptBytes(enc, N, K, buf_.data()); }
+        std::string_view view() const { return std::string_view(buf_.data(), N - 1); }
+        const char* c_str() const { return buf_.data(); }
+        ~DecryptedView() { WipePlaintext(buf_.data(), N); }
+
+        DecryptedView(const DecryptedView&) = delete;
+        DecryptedView& operator=(const DecryptedView&) = delete;
+    };
+
+    // --------- Script-precomputed per-TU table (obfuscate.py --string-table) ----------
+    // The script encrypts each literal itself and appends one blob per TU; a site passes the
+    // blob accessor, the record offset, N and the key, so nothing is evaluated at compile time.
+    class TableString {
+        std::string decrypted_;
+    public:
+        TableString(const uint8_t* enc, std::size_t n, uint32_t K) : decrypted_(n, '\0') {
+            DecryptBytes(enc, n, K, &decrypted_[0]);
+        }
+        operator const std::string& () const { return decrypted_; }
+        const char* c_str() const { return decrypted_.c_str(); }
+        std::size_t length() const { return decrypted_.length(); }
+        friend std::ostream& operator<<(std::ostream& os, const TableString& s) { return os << s.c_str(); }
+        ~TableString() { WipePlaintext(&decrypted_[0], decrypted_.size()); }
+
+        TableString(const TableString&) = delete;
+        TableString& operator=(const TableString&) = delete;
+    };
+
+    // OBF_STRING_TABLE_VERIFY: the generated table checks each record against ObfuscateString.
+    template <std::size_t N, uint32_t SEED>
+    constexpr bool TableRecordMatches(const char(&lit)[N], const unsigned char* rec) {
+        const auto enc = ObfuscateString<N, SEED>(lit);
+        for (std::size_t i = 0; i < N; ++i)
+            if (enc[i] != rec[i]) return false;
+        return true;
+    }
+
     // ---- Single-eval seed + macros ----
 #ifdef __COUNTER__
 #define OBF_UNIQUE_SEED ::StringObfuscator::mix32(static_cast<uint32_t>((__COUNTER__ * 1664525u) ^ static_cast<uint32_t>(__LINE__)))
@@ -227,12 +276,36 @@ namespace StringObfuscator {
         static ::StringObfuscator::ObfuscatedString<sizeof(lit), (SEED)> _inst(_enc); \
         return _inst.c_str();                                                          \
     }())
+
+// Only valid inside the call it is passed to: the view dangles after the full-expression.
+#define OBF_MAKE_OBS_VIEW(lit, SEED)                                                  \
+    ::StringObfuscator::DecryptedView<sizeof(lit)>([]() {                             \
+        constexpr auto _enc = ::StringObfuscator::ObfuscateString<sizeof(lit), (SEED)>(lit); \
+        return _enc;                                                                   \
+    }().data(), ::StringObfuscator::StringKey((SEED), sizeof(lit))).view()
+
+// Table references written by obfuscate.py --string-table: tab() is the TU's blob.
+#define OBS_TBL(tab, off, n, key)                                                     \
+    ([]() -> const ::StringObfuscator::TableString& {                                 \
+        static const ::StringObfuscator::TableString _inst(tab() + (off), (n), (key)); \
+        return _inst;                                                                  \
+    }())
+
+#define OBS_TBL_CSTR(tab, off, n, key)                                                \
+    ([]() -> const char* {                                                            \
+        static const ::StringObfuscator::TableString _inst(tab() + (off), (n), (key)); \
+        return _inst.c_str();                                                          \
+    }())
+
+#define OBS_TBL_VIEW(tab, off, n, key)                                                \
+    ::StringObfuscator::DecryptedView<(n)>(tab() + (off), (key)).view()
 } // namespace StringObfuscator
 
 // ---- Narrow (existing)
 #define OBS(lit)      OBF_MAKE_OBS(lit,      OBF_UNIQUE_SEED)
 #define OBS_STR(lit)  OBF_MAKE_OBS_STR(lit,  OBF_UNIQUE_SEED)
 #define OBS_CSTR(lit) OBF_MAKE_OBS_CSTR(lit, OBF_UNIQUE_SEED)
+#define OBS_VIEW(lit) OBF_MAKE_OBS_VIEW(lit, OBF_UNIQUE_SEED)
 
 // ---- Additional literal kinds ----
 #define OBS_U8(lit)   OBS(lit)